@@ -1,543 +1,4217 @@
-#include <bits/stdc++.h>
-using namespace std;
-
-class Register {
-private:
-    string hexValue;
-
-public:
-    Register() : hexValue("00") {}
-    void load_value(const string &val) { hexValue = val; }
-    string get_value() { return hexValue; }
-    int get_int_value() { return stoi(hexValue, nullptr, 16); }
-};
-
-class Memory {
-private:
-    vector<string> cells;
-    int programCounter;
-
-public:
-    Memory() : cells(256, "00"), programCounter(0) {}
-
-    string read(int address) {
-        return (address >= 0 && address < cells.size()) ? cells[address] : "00";
-    }
-
-    void write(int addr, const string &val) {
-        if (addr >= 0 && addr + 1 < cells.size() && val.length() == 4) {
-            // Split instruction into two parts and store them in adjacent memory cells
-            string part1 = val.substr(0, 2);  // First two digits
-            string part2 = val.substr(2, 2);  // Last two digits
-            cells[addr] = part1;
-            cells[addr + 1] = part2;
-        }
-    }
-
-    void executeInstruction() {
-        while (programCounter < cells.size()) {
-            string instruction = cells[programCounter] + cells[programCounter + 1];
-
-            if (instruction == "C000") {
-                cout << " HALT instruction encountered. Stopping execution." << endl;
-                break;
-            }
-            // More instruction handling...
-
-            programCounter += 2;  // Move to next instruction
-        }
-    }
-
-    void display() {
-        cout << "\nMemory Display:\n";
-        cout << "      "; // Offset for row header
-        for (int j = 0; j < 16; j++) {
-            cout << " " << hex << uppercase << j << " ";
-        }
-        cout << "\n     ------------------------------------------------\n";
-
-        for (int i = 0; i < cells.size(); i++) {
-            if (i % 16 == 0) {
-                cout << setw(2) << setfill('0') << hex << uppercase << (i / 16) << " | ";
-            }
-
-            // Print current memory cell value
-            cout << setw(2) << hex << uppercase << cells[i] << " ";
-
-            // If it's the 16th cell, move to the next line
-            if ((i + 1) % 16 == 0) {
-                cout << endl;
-            }
-        }
-        cout << "\n";
-    }
-};
-
-class Instruction {
-public:
-    virtual void execute(Register *registers, Memory &memory, int &pc) = 0;
-};
-
-class LoadImmediate : public Instruction {
-private:
-    int regIndex;
-    string value;
-
-public:
-    LoadImmediate(int reg, const string &val) : regIndex(reg), value(val) {}
-    void execute(Register *registers, Memory &memory, int &pc) {
-        registers[regIndex].load_value(value);
-        cout << "LOAD R" << regIndex << " immediate value = " << registers[regIndex].get_value() << endl;
-    }
-};
-
-class LoadFromMemory : public Instruction {
-private:
-    int regIndex;
-    int address;
-
-public:
-    LoadFromMemory(int reg, int addr) : regIndex(reg), address(addr) {}
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        registers[regIndex].load_value(memory.read(address));
-        cout << "LOAD R" << regIndex << " from Memory[" << address << "] = " << registers[regIndex].get_value() << endl;
-    }
-};
-
-
-class StoreToMemory : public Instruction {
-private:
-    int regIndex;
-    int address;
-
-public:
-    StoreToMemory(int reg, int addr) : regIndex(reg), address(addr) {}
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        memory.write(address, registers[regIndex].get_value());
-        cout << "STORE R" << regIndex << " to Memory[" << address << "]" << endl;
-    }
-};
-
-class Add : public Instruction {
-private:
-    int regDest;
-    int regSrc1;
-    int regSrc2;
-public:
-    Add(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
-
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        int value1 = static_cast<int8_t>(registers[regSrc1].get_int_value());
-        int value2 = static_cast<int8_t>(registers[regSrc2].get_int_value());
-        int sum = value1 + value2;
-        int result = static_cast<int8_t>(sum);
-        stringstream ss;
-        ss << uppercase << hex << setw(2) << setfill('0') << (result & 0xFF);
-        registers[regDest].load_value(ss.str());
-        cout << "ADD R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest << " = " << registers[regDest].get_value() << endl;
-    }
-};
-class AddFloat : public Instruction {
-private:
-    int regDest;  // Destination register
-    int regSrc1;  // First source register
-    int regSrc2;  // Second source register
-    const int bias = 4;
-
-public:
-    // Constructor
-    AddFloat(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
-
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        // Interpret register values as 8-bit floating-point representations
-        uint8_t val1 = registers[regSrc1].get_int_value();
-        uint8_t val2 = registers[regSrc2].get_int_value();
-
-        // Extract sign, exponent, and mantissa for val1
-        int sign1 = (val1 >> 7) & 0x1;
-        int exponent1 = ((val1 >> 4) & 0x7) - bias; // Apply bias to exponent
-        int mantissa1 = val1 & 0xF;
-
-        // Extract sign, exponent, and mantissa for val2
-        int sign2 = (val2 >> 7) & 0x1;
-        int exponent2 = ((val2 >> 4) & 0x7) - bias; // Apply bias to exponent
-        int mantissa2 = val2 & 0xF;
-
-        // Convert to normalized floating-point values
-        double float1 = pow(-1, sign1) * (1 + mantissa1 / 16.0) * pow(2, exponent1);
-        double float2 = pow(-1, sign2) * (1 + mantissa2 / 16.0) * pow(2, exponent2);
-
-        // Perform floating-point addition
-        double resultFloat = float1 + float2;
-
-        // Determine sign of result
-        int resultSign = resultFloat < 0 ? 1 : 0;
-        resultFloat = abs(resultFloat);
-
-        // Normalize result exponent and mantissa
-        int resultExponent = 0;
-        int resultMantissa = 0;
-
-        if (resultFloat != 0) {
-            resultExponent = static_cast<int>(log2(resultFloat));
-            resultMantissa = static_cast<int>((resultFloat / pow(2, resultExponent)) * 16) & 0xF;
-
-            // Apply the bias to the exponent
-            resultExponent += bias;
-
-            // Ensure exponent fits within 3 bits and mantissa within 4 bits
-            if (resultExponent > 7) {
-                resultExponent = 7;
-                resultMantissa = 0xF;  // Set mantissa to max if exponent overflow
-            } else if (resultExponent < 0) {
-                resultExponent = 0;
-                resultMantissa = 0;  // Set to zero if exponent underflow
-            }
-        }
-
-        // Pack into 8-bit floating-point format
-        uint8_t result = (resultSign << 7) | ((resultExponent & 0x7) << 4) | (resultMantissa & 0xF);
-
-        // Store result in destination register
-        stringstream ss;
-        ss << uppercase << hex << setw(2) << setfill('0') << (result & 0xFF);
-        registers[regDest].load_value(ss.str());
-
-        // Display the result of the operation for debugging purposes
-        cout << "ADD_FLOAT R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest
-             << " = " << registers[regDest].get_value() << endl;
-    }
-};
-
-class StoreToFixedMemory : public Instruction {
-private:
-    int regIndex;
-
-public:
-    StoreToFixedMemory(int reg) : regIndex(reg) {}
-
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        string hexValue = registers[regIndex].get_value();
-
-        try {
-            int intValue = stoi(hexValue, nullptr, 16);
-            if (intValue >= 0 && intValue <= 127) { // Ensure it’s a valid ASCII range
-                char asciiChar = static_cast<char>(intValue);
-
-                // Retrieve current content in memory[0] and append the new ASCII character
-                string currentString = memory.read(0);
-                currentString += asciiChar;
-
-                // Store the updated string back to memory[0]
-                memory.write(0, currentString);
-
-                cout << "STORE R" << regIndex << " to Memory[00] as ASCII '" << asciiChar << "'; updated Memory[00] = \"" << currentString << "\"" << endl;
-            } else {
-                cout << "Value in R" << regIndex << " is out of ASCII range for Memory[00]." << endl;
-            }
-        } catch (const invalid_argument& e) {
-            cout << "Error: Invalid hex value in R" << regIndex << ": " << hexValue << endl;
-        } catch (const out_of_range& e) {
-            cout << "Error: Hex value in R" << regIndex << " is out of range: " << e.what() << endl;
-        }
-    }
-};
-
-
-class JumpIfEqual : public Instruction {
-private:
-    int regIndex; // Register to compare with R0
-    int address;  // Address to jump to
-
-public:
-    JumpIfEqual(int reg, int addr) : regIndex(reg), address(addr) {}
-
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        // Compare the contents of the specified register with R0
-        if (registers[regIndex].get_value() == registers[0].get_value()) {
-            // Set the program counter to the target address
-            pc = address; // Set PC to the target address directly
-            cout << "JUMP to instruction at memory address [" << pc << "]" << endl;
-        } else {
-            cout << "No JUMP: R" << regIndex << " (" << registers[regIndex].get_value()
-                 << ") != R0 (" << registers[0].get_value() << ")" << endl;
-        }
-    }
-};
-
-
-class CopyRegister : public Instruction {
-private:
-    int sourceReg;
-    int destReg;
-
-public:
-    CopyRegister(int srcReg, int destReg) : sourceReg(srcReg), destReg(destReg) {}
-
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        registers[destReg].load_value(registers[sourceReg].get_value());
-        cout << "COPY from R" << sourceReg << " to R" << destReg << " = " << registers[destReg].get_value() << endl;
-    }
-};
-
-class Halt : public Instruction {
-public:
-    void execute(Register *registers, Memory &memory, int &pc) override {
-        pc = -1; // Halt execution
-        cout << "HALT execution." << endl;
-    }
-};
-
-class Machine {
-private:
-    vector<Register> registers;
-    Memory memory;
-    int programCounter;
-    vector<unique_ptr<Instruction>> instructionSet;
-
-public:
-    Machine() : registers(16), programCounter(0) {}
-
-    void run() {
-        while (programCounter >= 0 && programCounter < instructionSet.size()) {
-            int oldPC = programCounter;  // Save the current program counter
-            instructionSet[programCounter]->execute(registers.data(), memory, programCounter);
-
-            display_status(); // Show register and memory status after each instruction
-
-            // Only increment the program counter if it wasn't modified by the instruction
-            if (programCounter == oldPC) {
-                programCounter++;
-            }
-
-            // If the program counter is set to -1 (by a Halt instruction), stop the program.
-            if (programCounter == -1) {
-                break;
-            }
-        }
-    }
-
-    void display_status() {
-        cout << "\nRegisters Status:\n";
-        for (int i = 0; i < registers.size(); ++i) {
-            cout << "Register[" << i << "] = " << registers[i].get_value() << endl;
-        }
-
-        cout << "\nMemory Status:\n";
-        memory.display(); // Show only non-empty memory cells
-
-        // Check if memory[0] is not empty and has a valid value for display
-        string hexValue = memory.read(0);
-        if (!hexValue.empty() && hexValue != "00") { // Ensure non-empty and non-default
-            try {
-                // Convert hex value "20" directly to a space character
-                if (hexValue == "20") {
-                    cout << "Expected value: <space>" << endl; // Explicitly display a space character
-                } else { // Handle other valid hex values
-                    int intValue = stoi(hexValue, nullptr, 16); // Convert hex string to integer
-                    if (intValue >= 0 && intValue <= 127) { // Printable ASCII range check
-                        char asciiChar = static_cast<char>(intValue);
-                        cout << "Expected value: " << asciiChar << endl;
-                    } else {
-                        cout << "Expected value: Non-printable ASCII character." << endl;
-                    }
-                }
-            } catch (const invalid_argument& e) {
-                cout << "Error: Invalid hex value in Memory[00]: " << hexValue << endl;
-            } catch (const out_of_range& e) {
-                cout << "Error: Hex value in Memory[00] is out of range: " << e.what() << endl;
-            }
-        } else {
-            cout << "Memory[00] is empty or contains default value '00'." << endl;
-        }
-
-        cout << "Program Counter = " << programCounter << endl;
-    }
-
-
-    void manual_input() {
-        int startAddress;
-        cout << "Enter the starting memory address to store instructions: ";
-        cin >> startAddress;
-
-        string instruction;
-        cout << "Enter instructions (4 characters each, or 'C000' to finish): \n";
-        int address = startAddress;
-        while (true) {
-            cout << "Instruction: ";
-            cin >> instruction;
-            if (instruction.length() == 4) {
-                char opcode = instruction[0];
-                int regIndex = instruction[1] - '0'; // Convert char to int for register index
-                string hexValue = instruction.substr(2); // Get the last two characters as hex string
-                switch (opcode) {
-                    case '1':{
-
-                        int memAddress = stoi(hexValue, nullptr, 16); // Convert the last two characters to an integer address
-                        instructionSet.push_back(make_unique<LoadFromMemory>(regIndex, memAddress));
-                        break;
-                    }
-                    case '2': // LOAD immediate
-                        instructionSet.push_back(make_unique<LoadImmediate>(regIndex, hexValue));
-                        break;
-                    case '3': // LOAD from memory
-                        instructionSet.push_back(make_unique<StoreToMemory>(regIndex, stoi(hexValue, nullptr, 16))); // Always store to memory
-                        break;
-
-                    case '4': // STORE or COPY
-                        if (instruction[1] == '0') { // Detecting the 40 prefix for copy
-                            int destReg = instruction[3] - '0'; // Get the destination register index
-                            instructionSet.push_back(make_unique<CopyRegister>(10, destReg)); // Assuming 'A' corresponds to index 10
-                        }
-                        break;
-                    case '5': { // ADD
-                        int regDest = regIndex;
-                        int regSrc1 = instruction[2] - '0';
-                        int regSrc2 = instruction[3] - '0';
-                        instructionSet.push_back(make_unique<Add>(regDest, regSrc1, regSrc2));
-                        break;
-                    }
-                    case '6': { // Floating-point ADD
-                        int regDest = regIndex;
-                        int regSrc1 = instruction[2] - '0';
-                        int regSrc2 = instruction[3] - '0';
-                        instructionSet.push_back(make_unique<AddFloat>(regDest, regSrc1, regSrc2));
-                        break;
-                    }
-                    case 'B': {
-
-                        int memAddress = stoi(hexValue); // Convert the last two characters to an integer address
-                        instructionSet.push_back(make_unique<JumpIfEqual>(regIndex,memAddress));
-                        break;
-                    }// JUMP if equal
-                    case 'C': // HALT
-                        instructionSet.push_back(make_unique<Halt>());
-                        memory.write(address, instruction); // Store HALT in memory
-                        cout << "HALT instruction added at Memory[" << address << "]. Stopping instruction input.\n";
-                        programCounter = 0; // Reset program counter for execution
-                        return; // Stop taking further instructions
-                    default:
-                        cout << "Invalid opcode: " << opcode << endl;
-                        break;
-                }
-                memory.write(address, instruction); // Store instruction in memory at specified address
-                cout << "Instruction '" << instruction << "' added at Memory[" << address << "]." << endl;
-                address++;
-            } else {
-                cout << "Invalid instruction length. Instructions must be 4 characters long.\n";
-            }
-        }
-        programCounter = 0; // Reset program counter for execution
-    }
-
-
-
-    void menu() {
-        int choice;
-        do {
-            cout << "\n1. Load Program\n2. Run\n3. Display Status\n4. Enter Instructions Manually\n5. Exit\nChoice: ";
-            cin >> choice;
-            switch (choice) {
-                case 1: {
-                    string filename;
-                    cout << "Enter program file path: ";
-                    cin >> filename;
-                    load_program(filename);
-                    break;
-                }
-                case 2: run(); break;
-                case 3: display_status(); break;
-                case 4: {
-                    manual_input();
-                    run();
-                    break;
-                }
-                case 5: cout << "Exiting...\n"; break;
-                default: cout << "Invalid choice.\n"; break;
-            }
-        } while (choice != 5);
-    }
-    void load_program(const string &filename) {
-        ifstream file(filename);
-        if (!file.is_open()) {
-            cout << "Error: Unable to open file. Please check the file path and try again.\n";
-            return;
-        }
-
-        cout << "File loaded successfully.\n";
-        string instruction;
-        int startAddress;
-        cout << "Enter the starting memory address to store instructions: ";
-        cin >> startAddress;
-        int address = startAddress;
-
-        while (file >> instruction) {
-            if (instruction.length() == 4) {
-                char opcode = instruction[0];
-                int regIndex = instruction[1] - '0';
-                string hexValue = instruction.substr(2);
-
-                switch (opcode) {
-                    case '1': {
-                        int memAddress = stoi(hexValue, nullptr, 16); // Convert last two characters to integer address
-                        instructionSet.push_back(make_unique<LoadFromMemory>(regIndex, memAddress));
-                        break;
-                    }
-                    case '2': // LOAD immediate
-                        instructionSet.push_back(make_unique<LoadImmediate>(regIndex, hexValue));
-                        break;
-                    case '3': // STORE to memory
-                        instructionSet.push_back(make_unique<StoreToMemory>(regIndex, stoi(hexValue, nullptr, 16)));
-                        break;
-                    case '4': { // STORE or COPY
-                        if (hexValue[0] == '0') { // Detect the 40 prefix for copy
-                            int destReg = hexValue[1] - '0'; // Get destination register index
-                            instructionSet.push_back(make_unique<CopyRegister>(10, destReg)); // Assuming 'A' corresponds to index 10
-                        }
-                        break;
-                    }
-                    case '5': { // ADD
-                        int regDest = regIndex;
-                        int regSrc1 = instruction[2] - '0';
-                        int regSrc2 = instruction[3] - '0';
-                        instructionSet.push_back(make_unique<Add>(regDest, regSrc1, regSrc2));
-                        break;
-                    }
-                    case '6': { // Floating-point ADD
-                        int regDest = regIndex;
-                        int regSrc1 = instruction[2] - '0';
-                        int regSrc2 = instruction[3] - '0';
-                        instructionSet.push_back(make_unique<AddFloat>(regDest, regSrc1, regSrc2));
-                        break;
-                    }
-                    case 'B': { // JUMP if equal
-                        int memAddress = stoi(hexValue);
-                        instructionSet.push_back(make_unique<JumpIfEqual>(regIndex, memAddress));
-                        break;
-                    }
-                    case 'C': // HALT
-                        instructionSet.push_back(make_unique<Halt>());
-                        memory.write(address, instruction); // Store HALT in memory
-                        cout << "HALT instruction found. Stopping program loading at Memory[" << address << "].\n";
-                        programCounter = 0; // Reset program counter
-                        file.close(); // Close the file after processing
-                        return; // Stop reading further instructions
-                    default:
-                        cout << "Invalid opcode in file: " << opcode << endl;
-                        break;
-                }
-
-                memory.write(address, instruction); // Store instruction in memory at specified address
-                address++;
-            } else {
-                cout << "Skipping invalid instruction in file: " << instruction << endl;
-            }
-        }
-        programCounter = 0; // Reset program counter
-    }
-};
-int main() {
-    Machine machine;
-    machine.menu();
-    return 0;
-}
\ No newline at end of file
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+class Register {
+private:
+    uint8_t value;
+
+public:
+    Register() : value(0) {}
+    void load_value(int val) { value = val & 0xFF; }
+    uint8_t get_value() const { return value; }
+};
+
+// Prints a byte as two uppercase hex digits without changing the stream's formatting
+struct HexByte {
+    uint8_t value;
+};
+
+HexByte hex_byte(int value) { return HexByte{static_cast<uint8_t>(value)}; }
+
+ostream &operator<<(ostream &out, HexByte byte) {
+    static const char digits[] = "0123456789ABCDEF";
+    return out << digits[byte.value >> 4] << digits[byte.value & 0xF];
+}
+
+class Memory {
+private:
+    // Relaxed atomics let several Cpus share one Memory; on common hosts they compile to the
+    // same plain byte loads and stores as ordinary cells. Multiprocessor threads add the fences
+    // that order guest accesses between instructions.
+    array<atomic<uint8_t>, 256> cells;
+
+public:
+    Memory() {
+        for (atomic<uint8_t> &cell : cells) cell.store(0, memory_order_relaxed);
+    }
+
+    Memory(const Memory &other) { *this = other; }
+
+    Memory &operator=(const Memory &other) {
+        for (size_t i = 0; i < cells.size(); i++) {
+            cells[i].store(other.cells[i].load(memory_order_relaxed), memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    uint8_t read(int address) const {
+        return (address >= 0 && address < cells.size()) ? cells[address].load(memory_order_relaxed) : 0;
+    }
+
+    void write(int addr, int val) {
+        if (addr >= 0 && addr < cells.size()) {
+            cells[addr].store(val & 0xFF, memory_order_relaxed);
+        }
+    }
+
+    // Like read and write, for an address known to be in range
+    uint8_t read_unchecked(int address) const { return cells[address].load(memory_order_relaxed); }
+    void write_unchecked(int address, int value) { cells[address].store(value & 0xFF, memory_order_relaxed); }
+
+    // Stores desired if the cell holds expected, as one atomic step. Returns the value the cell
+    // held. Sequentially consistent, so taking a guest lock with it is an acquire. The relaxed
+    // STORE that releases such a lock orders nothing by itself.
+    uint8_t compare_exchange(int address, uint8_t expected, uint8_t desired) {
+        cells[address].compare_exchange_strong(expected, desired);
+        return expected;
+    }
+
+    void display() {
+        cout << "\nMemory Display:\n";
+        cout << "      "; // Offset for row header
+        for (int j = 0; j < 16; j++) {
+            cout << " " << hex << uppercase << j << " ";
+        }
+        cout << "\n     ------------------------------------------------\n";
+
+        for (int i = 0; i < cells.size(); i++) {
+            if (i % 16 == 0) {
+                cout << setw(2) << setfill('0') << hex << uppercase << (i / 16) << " | ";
+            }
+
+            // Print current memory cell value
+            cout << hex_byte(read(i)) << " ";
+
+            // If it's the 16th cell, move to the next line
+            if ((i + 1) % 16 == 0) {
+                cout << endl;
+            }
+        }
+        cout << "\n";
+    }
+};
+
+// Value of a single hexadecimal digit, or -1 if the character is not one
+constexpr int hex_digit(char c) {
+    return (c >= '0' && c <= '9') ? c - '0'
+         : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+         : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+         : -1;
+}
+
+// Parses two hex digits starting at text[pos]; returns -1 if either is not a hex digit
+int parse_hex_byte(const string &text, int pos = 0) {
+    if (pos < 0 || static_cast<size_t>(pos) + 2 > text.length()) return -1;
+    int high = hex_digit(text[pos]);
+    int low = hex_digit(text[pos + 1]);
+    return (high < 0 || low < 0) ? -1 : (high << 4) | low;
+}
+
+// Parses a whole string of hex digits (at most 6); returns -1 if it is empty or not hex
+int parse_hex(const string &text) {
+    if (text.empty() || text.length() > 6) return -1;
+    int value = 0;
+    for (char c : text) {
+        if (hex_digit(c) < 0) return -1;
+        value = (value << 4) | hex_digit(c);
+    }
+    return value;
+}
+
+// Number of significant bits in value
+constexpr int bit_width(unsigned value) {
+    int width = 0;
+    for (; value; value >>= 1) ++width;
+    return width;
+}
+
+// Adds two 8-bit floats: sign bit, 3-bit exponent with bias 4, 4-bit mantissa with an implicit
+// leading 1, so a byte SEEEMMMM is (-1)^S * (1 + M/16) * 2^(E-4). Both operands are exact
+// multiples of 2^-8 and are added as integers in those units. The result exponent is log2 of
+// the sum truncated toward zero, and the mantissa is the low 4 bits of the sum scaled by that
+// exponent; exponents above 7 saturate to 7 with mantissa F and exponents below 0 give zero.
+constexpr uint8_t float_add(uint8_t a, uint8_t b) {
+    int sum = 0;
+    for (uint8_t value : {a, b}) {
+        int magnitude = (16 + (value & 0xF)) << ((value >> 4) & 0x7);
+        sum += value & 0x80 ? -magnitude : magnitude;
+    }
+    if (sum == 0) return 0;
+
+    unsigned magnitude = sum < 0 ? -sum : sum;
+    // Truncating toward zero rounds log2 down at or above 1 and up below 1
+    int exponent = magnitude >= 256 ? bit_width(magnitude) - 9 : bit_width(magnitude - 1) - 8;
+    int shift = -4 - exponent;
+    int mantissa = (shift >= 0 ? magnitude << shift : magnitude >> -shift) & 0xF;
+    exponent += 4;
+    if (exponent > 7) {
+        exponent = 7;
+        mantissa = 0xF;
+    } else if (exponent < 0) {
+        exponent = 0;
+        mantissa = 0;
+    }
+    return (sum < 0 ? 0x80 : 0) | (exponent << 4) | mantissa;
+}
+
+// Instructions are small literal classes sharing one interface instead of a virtual base, so a
+// decoded instruction is a plain value (see DecodedInstruction) and can run in a constant
+// expression. create builds one from the register nibble and second byte of its word; execute
+// runs it against a context that supplies the registers, memory and program counter, and a log
+// for the trace line. A context whose log is null runs it silently.
+
+class LoadImmediate {
+private:
+    int regIndex;
+    uint8_t value;
+
+public:
+    constexpr LoadImmediate(int reg, uint8_t val) : regIndex(reg), value(val) {}
+    static constexpr LoadImmediate create(int reg, int operand) { return LoadImmediate(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.set_register(regIndex, value);
+        if (ostream *log = context.log()) *log << "LOAD R" << regIndex << " immediate value = " << hex_byte(context.register_value(regIndex)) << endl;
+    }
+};
+
+class LoadFromMemory {
+private:
+    int regIndex;
+    int address;
+
+public:
+    constexpr LoadFromMemory(int reg, int addr) : regIndex(reg), address(addr) {}
+    static constexpr LoadFromMemory create(int reg, int operand) { return LoadFromMemory(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.set_register(regIndex, context.read(address));
+        if (ostream *log = context.log()) *log << "LOAD R" << regIndex << " from Memory[" << address << "] = " << hex_byte(context.register_value(regIndex)) << endl;
+    }
+};
+
+
+class StoreToMemory {
+private:
+    int regIndex;
+    int address;
+
+public:
+    constexpr StoreToMemory(int reg, int addr) : regIndex(reg), address(addr) {}
+    static constexpr StoreToMemory create(int reg, int operand) { return StoreToMemory(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.write(address, context.register_value(regIndex));
+        if (ostream *log = context.log()) *log << "STORE R" << regIndex << " to Memory[" << address << "]" << endl;
+    }
+};
+
+class Add {
+private:
+    int regDest;
+    int regSrc1;
+    int regSrc2;
+public:
+    constexpr Add(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
+    static constexpr Add create(int reg, int operand) { return Add(reg, operand >> 4, operand & 0xF); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        int value1 = static_cast<int8_t>(context.register_value(regSrc1));
+        int value2 = static_cast<int8_t>(context.register_value(regSrc2));
+        int sum = value1 + value2;
+        context.set_register(regDest, sum); // Keeps the low 8 bits, the two's complement result
+        if (ostream *log = context.log()) *log << "ADD R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest << " = " << hex_byte(context.register_value(regDest)) << endl;
+    }
+};
+class AddFloat {
+private:
+    int regDest;  // Destination register
+    int regSrc1;  // First source register
+    int regSrc2;  // Second source register
+
+public:
+    // Constructor
+    constexpr AddFloat(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
+    static constexpr AddFloat create(int reg, int operand) { return AddFloat(reg, operand >> 4, operand & 0xF); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.set_register(regDest, float_add(context.register_value(regSrc1), context.register_value(regSrc2)));
+
+        // Display the result of the operation for debugging purposes
+        if (ostream *log = context.log()) *log << "ADD_FLOAT R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest
+             << " = " << hex_byte(context.register_value(regDest)) << endl;
+    }
+};
+
+class JumpIfEqual {
+private:
+    int regIndex; // Register to compare with R0
+    int address;  // Address to jump to
+
+public:
+    constexpr JumpIfEqual(int reg, int addr) : regIndex(reg), address(addr) {}
+    static constexpr JumpIfEqual create(int reg, int operand) { return JumpIfEqual(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        // Compare the contents of the specified register with R0
+        if (context.register_value(regIndex) == context.register_value(0)) {
+            // Set the program counter to the target address
+            context.jump_to(address); // Set PC to the target address directly
+            if (ostream *log = context.log()) *log << "JUMP to instruction at memory address [" << context.program_counter() << "]" << endl;
+        } else {
+            if (ostream *log = context.log()) *log << "No JUMP: R" << regIndex << " (" << hex_byte(context.register_value(regIndex))
+                 << ") != R0 (" << hex_byte(context.register_value(0)) << ")" << endl;
+        }
+    }
+};
+
+
+class CopyRegister {
+private:
+    int sourceReg;
+    int destReg;
+
+public:
+    constexpr CopyRegister(int srcReg, int destReg) : sourceReg(srcReg), destReg(destReg) {}
+    static constexpr CopyRegister create(int reg, int operand) {
+        return CopyRegister(operand >> 4, operand & 0xF); // 40RS: R is the source, S the destination
+    }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.set_register(destReg, context.register_value(sourceReg));
+        if (ostream *log = context.log()) *log << "COPY from R" << sourceReg << " to R" << destReg << " = " << hex_byte(context.register_value(destReg)) << endl;
+    }
+};
+
+class Or {
+private:
+    int regDest;
+    int regSrc1;
+    int regSrc2;
+public:
+    constexpr Or(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
+    static constexpr Or create(int reg, int operand) { return Or(reg, operand >> 4, operand & 0xF); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        int result = context.register_value(regSrc1) | context.register_value(regSrc2);
+        context.set_register(regDest, result);
+        if (ostream *log = context.log()) *log << "OR R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest << " = " << hex_byte(context.register_value(regDest)) << endl;
+    }
+};
+
+class And {
+private:
+    int regDest;
+    int regSrc1;
+    int regSrc2;
+public:
+    constexpr And(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
+    static constexpr And create(int reg, int operand) { return And(reg, operand >> 4, operand & 0xF); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        int result = context.register_value(regSrc1) & context.register_value(regSrc2);
+        context.set_register(regDest, result);
+        if (ostream *log = context.log()) *log << "AND R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest << " = " << hex_byte(context.register_value(regDest)) << endl;
+    }
+};
+
+class Xor {
+private:
+    int regDest;
+    int regSrc1;
+    int regSrc2;
+public:
+    constexpr Xor(int dest, int src1, int src2) : regDest(dest), regSrc1(src1), regSrc2(src2) {}
+    static constexpr Xor create(int reg, int operand) { return Xor(reg, operand >> 4, operand & 0xF); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        int result = context.register_value(regSrc1) ^ context.register_value(regSrc2);
+        context.set_register(regDest, result);
+        if (ostream *log = context.log()) *log << "XOR R" << regSrc1 << " and R" << regSrc2 << " into R" << regDest << " = " << hex_byte(context.register_value(regDest)) << endl;
+    }
+};
+
+class Rotate {
+private:
+    int regIndex;
+    int steps; // Number of single-bit rotations to the right
+public:
+    constexpr Rotate(int reg, int count) : regIndex(reg), steps(count % 8) {}
+    static constexpr Rotate create(int reg, int operand) {
+        return Rotate(reg, operand & 0xF); // AR0X: only the low nibble is the count
+    }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        int value = context.register_value(regIndex);
+        int result = (value >> steps) | (value << (8 - steps));
+        context.set_register(regIndex, result);
+        if (ostream *log = context.log()) *log << "ROTATE R" << regIndex << " right " << steps << " times = " << hex_byte(context.register_value(regIndex)) << endl;
+    }
+};
+
+class JumpIfGreater {
+private:
+    int regIndex; // Register to compare with R0
+    int address;  // Address to jump to
+
+public:
+    constexpr JumpIfGreater(int reg, int addr) : regIndex(reg), address(addr) {}
+    static constexpr JumpIfGreater create(int reg, int operand) { return JumpIfGreater(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        // Both registers are compared as two's complement integers
+        int value = static_cast<int8_t>(context.register_value(regIndex));
+        int r0 = static_cast<int8_t>(context.register_value(0));
+        if (value > r0) {
+            context.jump_to(address);
+            if (ostream *log = context.log()) *log << "JUMP to instruction at memory address [" << context.program_counter() << "]" << endl;
+        } else {
+            if (ostream *log = context.log()) *log << "No JUMP: R" << regIndex << " (" << hex_byte(context.register_value(regIndex))
+                 << ") <= R0 (" << hex_byte(context.register_value(0)) << ")" << endl;
+        }
+    }
+};
+
+// Extension for multiprocessor programs: if Memory[XY] equals R0 it is replaced by R, as one
+// atomic step. R receives the old contents of Memory[XY], so R == R0 afterwards means success.
+class CompareAndSwap {
+private:
+    int regIndex;
+    int address;
+
+public:
+    constexpr CompareAndSwap(int reg, int addr) : regIndex(reg), address(addr) {}
+    static constexpr CompareAndSwap create(int reg, int operand) { return CompareAndSwap(reg, operand); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        uint8_t old = context.compare_exchange(address, context.register_value(0), context.register_value(regIndex));
+        context.set_register(regIndex, old);
+        if (ostream *log = context.log()) *log << "CAS R" << regIndex << " with Memory[" << address << "], old value = " << hex_byte(old) << endl;
+    }
+};
+
+class Halt {
+public:
+    static constexpr Halt create(int reg, int operand) { return Halt(); }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        context.jump_to(-1); // Halt execution
+        if (ostream *log = context.log()) *log << "HALT execution." << endl;
+    }
+};
+
+// A decoded instruction of any class, or monostate for none
+using DecodedInstruction = variant<monostate, LoadFromMemory, LoadImmediate, StoreToMemory, CopyRegister, Add, AddFloat,
+                                   Or, And, Xor, Rotate, JumpIfEqual, Halt, JumpIfGreater, CompareAndSwap>;
+
+template <typename T>
+constexpr DecodedInstruction decode_as(int reg, int operand) {
+    return T::create(reg, operand);
+}
+
+enum class Opcode : uint8_t {
+    Invalid, LoadFromMemory, LoadImmediate, StoreToMemory, Move, Add, AddFloat,
+    Or, And, Xor, Rotate, JumpIfEqual, Halt, JumpIfGreater, CompareAndSwap
+};
+constexpr int opcodeCount = static_cast<int>(Opcode::CompareAndSwap) + 1;
+
+using InstructionFactory = DecodedInstruction (*)(int reg, int operand);
+
+// One row of the decode table: everything the first byte of an instruction word determines
+struct DecodeEntry {
+    Opcode opcode = Opcode::Invalid;
+    uint8_t reg = 0;
+    const char *mnemonic = "INVALID";
+    InstructionFactory create = nullptr;
+    bool extension = false; // Only decoded when a machine enables extension opcodes
+};
+
+constexpr array<DecodeEntry, 256> make_decode_table() {
+    array<DecodeEntry, 256> table{};
+    for (int byte = 0; byte < 256; ++byte) {
+        DecodeEntry &entry = table[byte];
+        entry.reg = byte & 0xF;
+        switch (byte >> 4) {
+            case 0x1: entry = {Opcode::LoadFromMemory, entry.reg, "LOAD", &decode_as<LoadFromMemory>}; break;
+            case 0x2: entry = {Opcode::LoadImmediate, entry.reg, "LOADI", &decode_as<LoadImmediate>}; break;
+            case 0x3: entry = {Opcode::StoreToMemory, entry.reg, "STORE", &decode_as<StoreToMemory>}; break;
+            case 0x4: // 40RS, the second nibble must be zero
+                if (entry.reg == 0) entry = {Opcode::Move, 0, "MOVE", &decode_as<CopyRegister>};
+                break;
+            case 0x5: entry = {Opcode::Add, entry.reg, "ADD", &decode_as<Add>}; break;
+            case 0x6: entry = {Opcode::AddFloat, entry.reg, "ADDF", &decode_as<AddFloat>}; break;
+            case 0x7: entry = {Opcode::Or, entry.reg, "OR", &decode_as<Or>}; break;
+            case 0x8: entry = {Opcode::And, entry.reg, "AND", &decode_as<And>}; break;
+            case 0x9: entry = {Opcode::Xor, entry.reg, "XOR", &decode_as<Xor>}; break;
+            case 0xA: entry = {Opcode::Rotate, entry.reg, "ROT", &decode_as<Rotate>}; break;
+            case 0xB: entry = {Opcode::JumpIfEqual, entry.reg, "JMPEQ", &decode_as<JumpIfEqual>}; break;
+            case 0xC: // C000
+                if (entry.reg == 0) entry = {Opcode::Halt, 0, "HALT", &decode_as<Halt>};
+                break;
+            case 0xD: entry = {Opcode::JumpIfGreater, entry.reg, "JMPGT", &decode_as<JumpIfGreater>}; break;
+            case 0xE: entry = {Opcode::CompareAndSwap, entry.reg, "CAS", &decode_as<CompareAndSwap>, true}; break;
+            default: break;
+        }
+    }
+    return table;
+}
+
+// Indexed by the first byte of an instruction word
+constexpr array<DecodeEntry, 256> decodeTable = make_decode_table();
+
+// Decodes a 4-digit instruction word through the decode table. Returns the table entry, or
+// nullptr if the word is not a valid instruction; first and second receive the word's bytes.
+const DecodeEntry *decode_word(const string &instruction, int &first, int &second, bool extensions = false) {
+    first = parse_hex_byte(instruction, 0);
+    second = parse_hex_byte(instruction, 2);
+    if (instruction.length() != 4 || first < 0 || second < 0 || decodeTable[first].opcode == Opcode::Invalid
+        || (decodeTable[first].extension && !extensions)) {
+        return nullptr;
+    }
+    return &decodeTable[first];
+}
+
+// Assembly-style text for an instruction word, destination register first
+string disassemble(int first, int second) {
+    const DecodeEntry &entry = decodeTable[first];
+    int r = entry.reg, s = second >> 4, t = second & 0xF;
+    stringstream text;
+    text << uppercase << hex << entry.mnemonic; // Register numbers print as 0-F
+    switch (entry.opcode) {
+        case Opcode::LoadFromMemory:
+        case Opcode::StoreToMemory:
+        case Opcode::CompareAndSwap:
+            text << " R" << r << ", [0x" << hex_byte(second) << "]";
+            break;
+        case Opcode::LoadImmediate:
+        case Opcode::JumpIfEqual:
+        case Opcode::JumpIfGreater:
+            text << " R" << r << ", 0x" << hex_byte(second);
+            break;
+        case Opcode::Move:
+            text << " R" << t << ", R" << s;
+            break;
+        case Opcode::Add:
+        case Opcode::AddFloat:
+        case Opcode::Or:
+        case Opcode::And:
+        case Opcode::Xor:
+            text << " R" << r << ", R" << s << ", R" << t;
+            break;
+        case Opcode::Rotate:
+            text << " R" << r << ", " << t;
+            break;
+        case Opcode::Halt:
+            break;
+        case Opcode::Invalid:
+            text << " " << hex_byte(first) << hex_byte(second);
+            break;
+    }
+    return text.str();
+}
+
+// Policies for step_instruction and the machines built on it. Each is a small type whose checks,
+// output or counters compile away entirely when a configuration does not ask for them.
+
+// Range-checks every memory access, as Memory::read and write do
+struct CheckedBounds {
+    static constexpr bool enabled = true;
+};
+
+// Accesses memory without range checks. Data addresses are byte operands and instructions are
+// only fetched from a program counter already checked against the end of memory, so the checks
+// can never fail and leaving them out changes no result. Machine runs this way.
+struct UncheckedBounds {
+    static constexpr bool enabled = false;
+};
+
+// Trace policies give instructions the log their trace lines go to; a null log is silent
+struct NoTrace {
+    static constexpr ostream *log() { return nullptr; }
+};
+
+struct StreamTrace {
+    ostream *out = &cout;
+    ostream *log() const { return out; }
+};
+
+// Stats policies see every instruction before it executes: its opcode, its address and its
+// second byte, which is the memory address for loads, stores and CAS
+struct NoStats {
+    constexpr void count(Opcode opcode, int address, int operand) {}
+    void count_loop(const Memory &memory, int head, int length, long long steps) {}
+};
+
+// Instructions executed per opcode
+struct OpcodeStats {
+    array<long long, opcodeCount> counts{};
+
+    constexpr void count(Opcode opcode, int address, int operand) { ++counts[static_cast<int>(opcode)]; }
+
+    void report(ostream &out) const {
+        array<const char *, opcodeCount> names{};
+        for (const DecodeEntry &entry : decodeTable) names[static_cast<int>(entry.opcode)] = entry.mnemonic;
+        for (size_t opcode = 1; opcode < counts.size(); ++opcode) {
+            if (counts[opcode] > 0) out << names[opcode] << ": " << counts[opcode] << "\n";
+        }
+    }
+};
+
+// Costs for CycleModel. Every instruction costs its opcode's cycles plus one memory access to
+// fetch it and, for LOAD, STORE and CAS, one for the data. An access costs memory cycles, or
+// with a cache (lines > 0) hit cycles when it hits and memory cycles when it misses.
+struct CycleCosts {
+    array<int, opcodeCount> opcode;
+    int memory = 0;
+    int hit = 0;
+    int lines = 0;    // Direct-mapped cache lines, at most 256; 0 models no cache
+    int lineSize = 4; // Bytes per cache line, a power of two from 2 to 256
+
+    CycleCosts() { opcode.fill(1); }
+
+    // Reads comma-separated settings such as "ADDF=4,memory=10,hit=1,lines=8,line=4", where a
+    // mnemonic sets that opcode's cost. Returns false with a message in error on a bad setting.
+    bool parse(const string &spec, string &error) {
+        stringstream items(spec);
+        string item;
+        while (getline(items, item, ',')) {
+            size_t equals = item.find('=');
+            string key = item.substr(0, equals);
+            string number = equals == string::npos ? "" : item.substr(equals + 1);
+            int value = number.empty() || number.size() > 6 || number.find_first_not_of("0123456789") != string::npos
+                            ? -1 : stoi(number);
+            auto entry = find_if(decodeTable.begin(), decodeTable.end(), [&](const DecodeEntry &e) {
+                return e.opcode != Opcode::Invalid && key == e.mnemonic;
+            });
+            if (value < 0) {
+                error = "Expected <name>=<cycles> in '" + item + "'";
+            } else if (entry != decodeTable.end()) {
+                opcode[static_cast<int>(entry->opcode)] = value;
+            } else if (key == "memory") {
+                memory = value;
+            } else if (key == "hit") {
+                hit = value;
+            } else if (key == "lines" && value <= 256) {
+                lines = value;
+            } else if (key == "line" && value >= 2 && value <= 256 && (value & (value - 1)) == 0) {
+                lineSize = value;
+            } else {
+                error = "Unknown or out of range setting '" + item + "'";
+            }
+            if (!error.empty()) return false;
+        }
+        return true;
+    }
+};
+
+// Modelled cycles for a run. Stalls are the cycles accesses spent beyond the cost of a hit.
+struct CycleModel {
+    const CycleCosts *costs = nullptr;
+    long long cycles = 0;
+    long long stalls = 0;
+    long long hits = 0;
+    long long misses = 0;
+    array<int, 256> tags; // Line address held by each cache line, -1 when empty
+
+    CycleModel() { clear(); }
+
+    // Zeroes the totals and empties the cache, keeping the costs
+    void clear() {
+        cycles = stalls = hits = misses = 0;
+        tags.fill(-1);
+    }
+
+    void count(Opcode opcode, int address, int operand) {
+        cycles += costs->opcode[static_cast<int>(opcode)];
+        access(address); // An instruction never straddles a line, as lines hold an even number of bytes
+        if (opcode == Opcode::LoadFromMemory || opcode == Opcode::StoreToMemory || opcode == Opcode::CompareAndSwap) {
+            access(operand);
+        }
+    }
+
+    // Counts steps instructions of the length-instruction loop at head, run from its head over
+    // and over, as Cpu::fast_forward skips them. The loop only fetches its own words, so the cache
+    // holds the same lines after every iteration and each one after the first costs the same.
+    void count_loop(const Memory &memory, int head, int length, long long steps) {
+        auto run = [&](long long instructions) {
+            for (long long i = 0; i < instructions; ++i) {
+                int address = head + 2 * (i % length);
+                count(decodeTable[memory.read(address)].opcode, address, memory.read(address + 1));
+            }
+        };
+        long long iterations = steps / length;
+        if (iterations >= 2) {
+            run(length);
+            CycleModel warm = *this;
+            run(length);
+            long long more = iterations - 2;
+            cycles += more * (cycles - warm.cycles);
+            stalls += more * (stalls - warm.stalls);
+            hits += more * (hits - warm.hits);
+            misses += more * (misses - warm.misses);
+            steps -= iterations * length;
+        }
+        run(steps);
+    }
+
+    void access(int address) {
+        if (costs->lines > 0) {
+            int line = address / costs->lineSize;
+            int &tag = tags[line % costs->lines];
+            if (tag == line) {
+                ++hits;
+                cycles += costs->hit;
+                return;
+            }
+            tag = line;
+            ++misses;
+        }
+        cycles += costs->memory;
+        stalls += costs->memory - costs->hit;
+    }
+
+    // Percentage of accesses that hit, or -1 without a cache
+    double hit_rate() const { return hits + misses ? 100.0 * hits / (hits + misses) : -1; }
+};
+
+// One decoded instruction together with the word it was decoded from. Slots are plain values,
+// so they copy without sharing or allocating anything.
+class DecodedSlot {
+private:
+    DecodedInstruction instruction;
+    uint16_t word = 0;
+
+public:
+    constexpr const DecodedSlot *decode(const DecodeEntry &entry, int first, int second) {
+        word = (first << 8) | second;
+        instruction = entry.create(entry.reg, second);
+        return this;
+    }
+
+    // This slot, provided it was decoded from this word
+    constexpr const DecodedSlot *get(int first, int second) const {
+        return (instruction.index() != 0 && word == ((first << 8) | second)) ? this : nullptr;
+    }
+
+    constexpr Opcode opcode() const { return decodeTable[word >> 8].opcode; }
+    constexpr int operand() const { return word & 0xFF; }
+
+    template <typename Context>
+    constexpr void execute(Context &context) const {
+        visit([&context](const auto &decoded) {
+            if constexpr (!is_same<decay_t<decltype(decoded)>, monostate>::value) decoded.execute(context);
+        }, instruction);
+    }
+};
+
+// Executes the instruction at the program counter. This is the one step every machine runs; the
+// context supplies the machine state and decides how memory is checked and traced, and stats see
+// the instruction first. Returns false without executing anything if the machine has halted, run
+// off the end of memory or reached an invalid instruction.
+template <typename Context, typename Stats>
+constexpr bool step_instruction(Context &context, Stats &stats) {
+    int address = context.program_counter();
+    if (address < 0 || address + 1 >= 256) {
+        return false;
+    }
+    const DecodedSlot *slot = context.fetch(address);
+    if (!slot) {
+        return false;
+    }
+    stats.count(slot->opcode(), address, slot->operand());
+
+    // The program counter already points at the next instruction while this one executes,
+    // so jumps simply overwrite it and Halt sets it to -1.
+    context.jump_to(address + 2);
+    slot->execute(context);
+    return true;
+}
+
+// Machine state reduced to plain bytes, so that a program can run in a constant expression. It is
+// its own context for step_instruction and decodes each word as it fetches it.
+struct ConstexprMachine {
+    array<uint8_t, 16> registers{};
+    array<uint8_t, 256> memory{};
+    int programCounter = 0;
+    long long steps = 0;     // Instructions executed so far
+    bool extensions = false; // Whether extension opcodes such as CAS are decoded
+    DecodedSlot current{};   // The instruction being executed
+
+    constexpr bool halted() const { return programCounter == -1; }
+
+    // Copies count bytes to startAddress and points the program counter at them
+    constexpr void load(const uint8_t *bytes, size_t count, int startAddress) {
+        for (size_t i = 0; i < count && startAddress + i < memory.size(); ++i) memory[startAddress + i] = bytes[i];
+        programCounter = startAddress;
+    }
+
+    constexpr uint8_t register_value(int index) const { return registers[index]; }
+    constexpr void set_register(int index, int value) { registers[index] = static_cast<uint8_t>(value); }
+    constexpr uint8_t read(int address) const { return memory[address]; }
+    constexpr void write(int address, int value) { memory[address] = static_cast<uint8_t>(value); }
+    constexpr uint8_t compare_exchange(int address, uint8_t expected, uint8_t desired) {
+        uint8_t old = memory[address];
+        if (old == expected) memory[address] = desired;
+        return old;
+    }
+    constexpr int program_counter() const { return programCounter; }
+    constexpr void jump_to(int address) { programCounter = address; }
+    static constexpr ostream *log() { return nullptr; }
+
+    constexpr const DecodedSlot *fetch(int address) {
+        const DecodeEntry &entry = decodeTable[memory[address]];
+        if (entry.opcode == Opcode::Invalid || (entry.extension && !extensions)) {
+            return nullptr;
+        }
+        return current.decode(entry, memory[address], memory[address + 1]);
+    }
+
+    constexpr bool step() {
+        NoStats stats;
+        if (!step_instruction(*this, stats)) return false;
+        ++steps;
+        return true;
+    }
+
+    // Steps until the machine stops or has executed maxSteps more instructions; returns how many
+    // it executed
+    constexpr long long run(long long maxSteps) {
+        long long start = steps;
+        while (steps - start < maxSteps && step()) {}
+        return steps - start;
+    }
+};
+
+// Loads program at startAddress and runs it for at most maxSteps instructions. Called in a
+// constant expression, the compiler runs the program and its final state becomes a constant:
+//   constexpr ConstexprMachine state = run_constexpr(array<uint8_t, 4>{0x21, 0x05, 0xC0, 0x00});
+//   static_assert(state.halted() && state.registers[1] == 0x05, "");
+template <size_t N>
+constexpr ConstexprMachine run_constexpr(const array<uint8_t, N> &program, int startAddress = 0,
+                                         long long maxSteps = 100000, bool extensions = false) {
+    static_assert(N <= 256, "Program does not fit in memory");
+    ConstexprMachine machine;
+    machine.extensions = extensions;
+    machine.load(program.data(), N, startAddress);
+    machine.run(maxSteps);
+    return machine;
+}
+
+// Multiplies 7 by 6 with a counting loop and stores the product at Memory[40]; evaluated by the
+// compiler as a check of run_constexpr and float_add
+constexpr ConstexprMachine multiplyCheck = run_constexpr(array<uint8_t, 20>{
+    0x21, 0x07, 0x22, 0x06, 0x23, 0xFF, 0x20, 0x00, 0x52, 0x23, 0x54, 0x41, 0xB2, 0x10, 0xB0, 0x08, 0x34, 0x40, 0xC0, 0x00});
+static_assert(multiplyCheck.halted() && multiplyCheck.memory[0x40] == 42 && float_add(0x40, 0x40) == 0x50, "Compile-time interpreter disagrees");
+
+// A loaded program: its memory image and start address together with the decoded instruction
+// for each address. It is not modified after loading, so any number of Machines can share one.
+struct Program {
+    Memory image;
+    int startAddress = 0;
+    array<DecodedSlot, 256> decoded;
+};
+
+// One processor: a register file, program counter and decoded instruction cache. It executes
+// against a Memory it does not own, so several Cpus can share one.
+struct Cpu {
+    array<Register, 16> registers;
+    int programCounter = 0;
+    array<DecodedSlot, 256> instructionSet; // Decoded instruction for each memory address
+    bool extensions = false;                // Whether extension opcodes such as CAS are decoded
+    array<uint32_t, 256> rejectedLoops{};   // Per back-jump address: the jump word whose loop did not fit
+
+    // What instructions execute against: this cpu's registers and program counter and a shared
+    // Memory, accessed as the bounds policy says and traced as the trace policy says
+    template <typename Bounds, typename Trace>
+    struct Context {
+        Cpu &cpu;
+        Memory &memory;
+        const Program *program;
+        Trace &trace;
+
+        uint8_t register_value(int index) const { return cpu.registers[index].get_value(); }
+        void set_register(int index, int value) { cpu.registers[index].load_value(value); }
+        uint8_t read(int address) const { return Bounds::enabled ? memory.read(address) : memory.read_unchecked(address); }
+        void write(int address, int value) {
+            if (Bounds::enabled) memory.write(address, value);
+            else memory.write_unchecked(address, value);
+        }
+        uint8_t compare_exchange(int address, uint8_t expected, uint8_t desired) {
+            return memory.compare_exchange(address, expected, desired);
+        }
+        int program_counter() const { return cpu.programCounter; }
+        void jump_to(int address) { cpu.programCounter = address; }
+        ostream *log() const { return trace.log(); }
+        const DecodedSlot *fetch(int address) { return cpu.fetch<Bounds>(memory, program, address); }
+    };
+
+    // Returns the decoded instruction at address. Cached decodings are used while the word in
+    // memory is still the one they were decoded from, so stores over code are picked up;
+    // otherwise the word is decoded through the decode table. nullptr means an invalid opcode.
+    template <typename Bounds>
+    const DecodedSlot *fetch(const Memory &memory, const Program *program, int address) {
+        int first = Bounds::enabled ? memory.read(address) : memory.read_unchecked(address);
+        int second = Bounds::enabled ? memory.read(address + 1) : memory.read_unchecked(address + 1);
+        if (const DecodedSlot *slot = instructionSet[address].get(first, second)) {
+            return slot;
+        }
+        if (program) {
+            if (const DecodedSlot *slot = program->decoded[address].get(first, second)) {
+                return slot;
+            }
+        }
+        const DecodeEntry &entry = decodeTable[first];
+        if (entry.opcode == Opcode::Invalid || (entry.extension && !extensions)) {
+            return nullptr;
+        }
+        return instructionSet[address].decode(entry, first, second);
+    }
+
+    // Called right after a taken jump from jumpAddress back to the program counter. If the loop
+    // is a counting loop, jumps straight to the state stepping would reach at its exit, or at the
+    // head after the last whole iteration that fits in budget, and returns the number of
+    // instructions that stepping would have executed; otherwise returns 0 and leaves the state
+    // alone.
+    //
+    // A counting loop ends in an unconditional B0xx back to its head, and its body holds only
+    // ADDs of the form 5RRK/5RKR whose K registers the loop never changes, plus one BRxy leaving
+    // the loop. Every ADD then adds a fixed increment per iteration, so the iteration at which
+    // the exit register first equals R0 is the smallest k with v + k*D == R0 (mod 256). The head
+    // must lie an even distance before the jump, or stepping would decode different words.
+    long long fast_forward(const Memory &memory, int jumpAddress, long long budget) {
+        int head = programCounter;
+        int jumpFirst = memory.read(jumpAddress);
+        int jumpSecond = memory.read(jumpAddress + 1);
+        uint32_t jumpKey = 0x10000 | (jumpFirst << 8) | jumpSecond;
+        if (decodeTable[jumpFirst].opcode != Opcode::JumpIfEqual || decodeTable[jumpFirst].reg != 0
+            || (jumpAddress - head) % 2 != 0 || rejectedLoops[jumpAddress] == jumpKey) {
+            return 0;
+        }
+
+        int before[16] = {}, after[16] = {}; // Increments added before and after the exit test
+        bool changed[16] = {}, constant[16] = {};
+        int exitIndex = -1, exitRegister = 0, exitTarget = 0;
+        int length = (jumpAddress - head) / 2 + 1; // Instructions per iteration, the jump included
+        for (int i = 0; i + 1 < length; ++i) {
+            int first = memory.read(head + 2 * i);
+            int second = memory.read(head + 2 * i + 1);
+            const DecodeEntry &entry = decodeTable[first];
+            int dest = entry.reg, s = second >> 4, t = second & 0xF;
+            if (entry.opcode == Opcode::Add && (s == dest) != (t == dest)) {
+                int k = s == dest ? t : s;
+                (exitIndex < 0 ? before : after)[dest] += registers[k].get_value();
+                changed[dest] = constant[k] = true;
+            } else if (entry.opcode == Opcode::JumpIfEqual && exitIndex < 0 && dest != 0
+                       && (second < head || second > jumpAddress)) {
+                exitIndex = i;
+                exitRegister = dest;
+                exitTarget = second;
+            } else {
+                exitIndex = -2;
+                break;
+            }
+        }
+        bool fits = exitIndex >= 0 && !changed[0];
+        for (int r = 0; r < 16; ++r) fits = fits && !(changed[r] && constant[r]);
+        if (!fits) {
+            rejectedLoops[jumpAddress] = jumpKey;
+            return 0;
+        }
+
+        // Solve k*D == c (mod 256); with g = gcd(D, 256) there is a solution only if g divides c
+        int increment = (before[exitRegister] + after[exitRegister]) & 0xFF;
+        int target = (registers[0].get_value() - registers[exitRegister].get_value() - before[exitRegister]) & 0xFF;
+        int g = increment == 0 ? 256 : __gcd(increment, 256);
+        long long iterations = 0, steps = 0;
+        if (target % g == 0) {
+            int modulus = 256 / g, inverse = 0;
+            while ((increment / g) * inverse % modulus != 1 % modulus) ++inverse;
+            iterations = (target / g) * inverse % modulus;
+            steps = iterations * length + exitIndex + 1;
+        }
+        if (target % g != 0 || steps > budget) {
+            // The loop never exits, or not within the budget: run as many whole iterations as
+            // fit, which leaves the program counter at the head, and leave the rest to stepping
+            long long whole = budget / length;
+            for (int r = 0; r < 16; ++r) {
+                if (changed[r]) registers[r].load_value(registers[r].get_value() + (whole & 0xFF) * (before[r] + after[r]));
+            }
+            return whole * length;
+        }
+
+        for (int r = 0; r < 16; ++r) {
+            if (changed[r]) {
+                registers[r].load_value(registers[r].get_value() + iterations * (before[r] + after[r]) + before[r]);
+            }
+        }
+        programCounter = exitTarget;
+        return steps;
+    }
+
+    // Executes the instruction at the program counter with the given policies; see
+    // step_instruction
+    template <typename Bounds, typename Trace, typename Stats>
+    bool step(Memory &memory, const Program *program, Trace &trace, Stats &stats) {
+        Context<Bounds, Trace> context{*this, memory, program, trace};
+        return step_instruction(context, stats);
+    }
+
+    // Executes the instruction at the program counter unchecked, tracing to log unless it is null.
+    // Returns false without executing anything if the cpu has halted, run off the end of memory
+    // or reached an invalid instruction.
+    bool step(Memory &memory, const Program *program, ostream *log) {
+        NoStats stats;
+        if (log) {
+            StreamTrace trace{log};
+            return step<UncheckedBounds>(memory, program, trace, stats);
+        }
+        NoTrace trace;
+        return step<UncheckedBounds>(memory, program, trace, stats);
+    }
+};
+
+// Why a silent run that executed steps out of at most maxSteps instructions stopped
+const char *stop_reason(bool halted, long long steps, long long maxSteps) {
+    return halted ? "halted" : steps >= maxSteps ? "limit" : "invalid";
+}
+
+// Machine state published by an executing thread for a UI thread to read. The writer never
+// waits; a reader that overlapped a publish sees an odd or changed sequence number and retries.
+class StateSeqlock {
+public:
+    struct Snapshot {
+        array<uint8_t, 16> registers{};
+        array<uint8_t, 256> cells{};
+        int programCounter = 0;
+        long long steps = 0;
+        bool finished = false;
+    };
+
+private:
+    atomic<unsigned> sequence{0};
+    array<atomic<uint8_t>, 16> registers{};
+    array<atomic<uint8_t>, 256> cells{};
+    atomic<int> programCounter{0};
+    atomic<long long> steps{0};
+    atomic<bool> finished{false};
+
+public:
+    void publish(const Snapshot &state) {
+        unsigned start = sequence.load(memory_order_relaxed);
+        sequence.store(start + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (int i = 0; i < 16; ++i) registers[i].store(state.registers[i], memory_order_relaxed);
+        for (int i = 0; i < 256; ++i) cells[i].store(state.cells[i], memory_order_relaxed);
+        programCounter.store(state.programCounter, memory_order_relaxed);
+        steps.store(state.steps, memory_order_relaxed);
+        finished.store(state.finished, memory_order_relaxed);
+        sequence.store(start + 2, memory_order_release);
+    }
+
+    Snapshot read() const {
+        Snapshot state;
+        unsigned before, after;
+        do {
+            before = sequence.load(memory_order_acquire);
+            for (int i = 0; i < 16; ++i) state.registers[i] = registers[i].load(memory_order_relaxed);
+            for (int i = 0; i < 256; ++i) state.cells[i] = cells[i].load(memory_order_relaxed);
+            state.programCounter = programCounter.load(memory_order_relaxed);
+            state.steps = steps.load(memory_order_relaxed);
+            state.finished = finished.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            after = sequence.load(memory_order_relaxed);
+        } while (before != after || (before & 1));
+        return state;
+    }
+};
+
+class Machine {
+private:
+    Memory memory;
+    Cpu cpu;
+    shared_ptr<const Program> program;
+    optional<CycleModel> cycleModel; // Set while timing is on
+
+    // run_silent with a stats policy that also counts the instructions of skipped loops
+    template <typename Stats>
+    long long run_fast_forwarding(long long maxSteps, Stats &stats) {
+        NoTrace trace;
+        long long steps = 0;
+        while (steps < maxSteps) {
+            int pc = cpu.programCounter;
+            if (!cpu.step<UncheckedBounds>(memory, program.get(), trace, stats)) {
+                break;
+            }
+            ++steps;
+            if (cpu.programCounter >= 0 && cpu.programCounter <= pc) {
+                int head = cpu.programCounter;
+                long long skipped = cpu.fast_forward(memory, pc, maxSteps - steps);
+                if (skipped > 0) stats.count_loop(memory, head, (pc - head) / 2 + 1, skipped);
+                steps += skipped;
+            }
+        }
+        return steps;
+    }
+
+public:
+    Machine() {}
+
+    // A machine in the initial state of a shared program, reusing its decoded instructions
+    explicit Machine(shared_ptr<const Program> shared) : memory(shared->image), program(move(shared)) {
+        cpu.programCounter = program->startAddress;
+    }
+
+    // Copies the loaded memory image and decoded instructions into a Program for other Machines
+    shared_ptr<const Program> share_program() {
+        auto shared = make_shared<Program>();
+        shared->image = memory;
+        shared->startAddress = cpu.programCounter;
+        shared->decoded = cpu.instructionSet;
+        program = shared;
+        return shared;
+    }
+
+    // Returns to the initial state of the shared program. Decoded slots need no clearing since a
+    // slot is only used for the word it was decoded from; rejected loops are only keyed by their
+    // jump word, so they are forgotten.
+    void reset() {
+        cpu.registers = array<Register, 16>();
+        cpu.rejectedLoops.fill(0);
+        memory = program->image;
+        cpu.programCounter = program->startAddress;
+        if (cycleModel) cycleModel->clear();
+    }
+
+    // Switches to another shared program in its initial state, keeping this machine's decoded
+    // instruction cache warm
+    void use_program(shared_ptr<const Program> shared) {
+        program = move(shared);
+        reset();
+    }
+
+    // Lets loaded programs and the decoder use extension opcodes such as CAS
+    void enable_extensions() { cpu.extensions = true; }
+
+    // With costs, run_silent models the cycles of every instruction it runs and cycle_model()
+    // holds the totals since timing was set or the machine reset. nullptr turns timing off;
+    // costs must outlive the runs.
+    void set_timing(const CycleCosts *costs) {
+        cycleModel.reset();
+        if (costs) {
+            cycleModel.emplace();
+            cycleModel->costs = costs;
+        }
+    }
+
+    const CycleModel *cycle_model() const { return cycleModel ? &*cycleModel : nullptr; }
+
+    // Stores a 4-digit instruction word at address and caches its decoded form. Returns the
+    // decode table entry, or nullptr if the word is not a valid instruction.
+    const DecodeEntry *store_instruction(int address, const string &instruction) {
+        int first, second;
+        const DecodeEntry *entry = decode_word(instruction, first, second, cpu.extensions);
+        if (!entry || address < 0 || address + 1 >= 256) {
+            return nullptr;
+        }
+        place_instruction(address, *entry, first, second);
+        return entry;
+    }
+
+    // Stores a 4-digit word that is not a valid instruction as two data bytes at address, so the
+    // words after it keep their addresses. Returns false if the word is not 4 hex digits or does
+    // not fit in memory.
+    bool store_data(int address, const string &word) {
+        int first = parse_hex_byte(word, 0), second = parse_hex_byte(word, 2);
+        if (word.length() != 4 || first < 0 || second < 0 || address < 0 || address + 1 >= 256) {
+            return false;
+        }
+        memory.write(address, first);
+        memory.write(address + 1, second);
+        return true;
+    }
+
+    // Stores an instruction word whose decode table entry was looked up elsewhere, e.g. by a
+    // loader thread
+    void place_instruction(int address, const DecodeEntry &entry, int first, int second) {
+        memory.write(address, first);
+        memory.write(address + 1, second);
+        cpu.instructionSet[address].decode(entry, first, second);
+    }
+
+    int register_value(int index) { return cpu.registers[index].get_value(); }
+    void set_register(int index, int value) { cpu.registers[index].load_value(value); }
+    int cell_value(int address) { return memory.read(address); }
+    void set_cell(int address, int value) { memory.write(address, value); }
+    bool halted() const { return cpu.programCounter == -1; }
+
+    const char *stop_reason(long long steps, long long maxSteps) const { return ::stop_reason(halted(), steps, maxSteps); }
+    int program_counter() const { return cpu.programCounter; }
+    void jump_to(int address) { cpu.programCounter = address; }
+
+    // Runs without tracing or status output until the machine halts, reaches an invalid
+    // instruction or has executed maxSteps instructions. Returns the number executed. Counting
+    // loops are fast-forwarded to their exit (see Cpu::fast_forward), with the same result, count
+    // and modelled cycles as stepping through them.
+    long long run_silent(long long maxSteps) {
+        if (cycleModel) {
+            return run_fast_forwarding(maxSteps, *cycleModel);
+        }
+        NoStats stats;
+        return run_fast_forwarding(maxSteps, stats);
+    }
+
+    // Executes the instruction at the program counter; see Cpu::step
+    bool step(ostream *log) { return cpu.step(memory, program.get(), log); }
+
+    // Runs with the given bounds, trace and stats policies until the machine halts, reaches an
+    // invalid instruction or has executed maxSteps instructions; returns the number executed.
+    // Unlike run_silent it steps through counting loops, so stats see every instruction.
+    template <typename Bounds, typename Trace, typename Stats>
+    long long run_with(long long maxSteps, Trace &trace, Stats &stats) {
+        long long steps = 0;
+        while (steps < maxSteps && cpu.step<Bounds>(memory, program.get(), trace, stats)) {
+            ++steps;
+        }
+        return steps;
+    }
+
+    void run() {
+        while (step(&cout)) {
+            display_status(); // Show register and memory status after each instruction
+        }
+        if (cpu.programCounter >= 0 && cpu.programCounter + 1 < 256) {
+            cout << "Invalid instruction at Memory[" << cpu.programCounter << "]. Stopping execution." << endl;
+        }
+    }
+
+    StateSeqlock::Snapshot snapshot(long long steps, bool finished) {
+        StateSeqlock::Snapshot state;
+        for (int i = 0; i < 16; ++i) state.registers[i] = cpu.registers[i].get_value();
+        for (int i = 0; i < 256; ++i) state.cells[i] = memory.read(i);
+        state.programCounter = cpu.programCounter;
+        state.steps = steps;
+        state.finished = finished;
+        return state;
+    }
+
+    // Runs on a worker thread while a UI thread redraws the registers and memory at a fixed frame
+    // rate from snapshots taken through a seqlock. The executor only publishes a snapshot when a
+    // frame has asked for one, once per slice of instructions, so watching costs it nothing.
+    // Commands typed meanwhile: p pauses, s steps one instruction while paused, r resumes and
+    // q stops the run.
+    void run_watched(int framesPerSecond) {
+        StateSeqlock view;
+        atomic<bool> frameWanted{true}, paused{false}, stopRequested{false}, finished{false};
+        atomic<int> stepsWanted{0};
+        mutex controlLock;
+        condition_variable controlChanged;
+
+        thread executor([&]() {
+            const long long slice = 4096;
+            long long steps = 0;
+            while (!stopRequested.load()) {
+                long long limit = slice;
+                if (paused.load()) {
+                    view.publish(snapshot(steps, false)); // Show where the pause took effect
+                    unique_lock<mutex> guard(controlLock);
+                    controlChanged.wait(guard, [&]() { return !paused.load() || stepsWanted.load() > 0 || stopRequested.load(); });
+                    if (!paused.load() || stopRequested.load()) continue;
+                    --stepsWanted;
+                    limit = 1;
+                }
+                long long executed = run_silent(limit);
+                steps += executed;
+                bool done = executed < limit;
+                if (done || limit == 1 || frameWanted.exchange(false, memory_order_relaxed)) {
+                    view.publish(snapshot(steps, done));
+                }
+                if (done) break;
+            }
+            view.publish(snapshot(steps, true));
+            finished.store(true);
+        });
+
+        thread renderer([&]() {
+            while (true) {
+                bool last = finished.load();
+                frameWanted.store(true, memory_order_relaxed);
+                StateSeqlock::Snapshot state = view.read();
+                const char *status = state.finished ? (state.programCounter == -1 ? "Halted" : "Stopped")
+                                                    : paused.load() ? "Paused" : "Running";
+                cout << "\033[H\033[2J" << status
+                     << " - " << dec << state.steps << " instructions, PC = " << state.programCounter << "\n\nRegisters:";
+                for (int i = 0; i < 16; ++i) cout << " R" << hex << uppercase << i << "=" << hex_byte(state.registers[i]);
+                Memory cells;
+                for (int i = 0; i < 256; ++i) cells.write(i, state.cells[i]);
+                cells.display();
+                if (state.finished) cout << "Press Enter to return to the menu.\n" << flush;
+                else cout << dec << "Commands: p = pause, s = step, r = resume, q = stop\n" << flush;
+                if (last) break;
+                this_thread::sleep_for(chrono::milliseconds(1000 / framesPerSecond));
+            }
+        });
+
+        string command;
+        while (!finished.load() && getline(cin, command)) {
+            {
+                lock_guard<mutex> guard(controlLock);
+                if (command == "p") paused = true;
+                else if (command == "r") paused = false;
+                else if (command == "s") ++stepsWanted;
+                else if (command == "q") stopRequested = true;
+            }
+            controlChanged.notify_all();
+        }
+        {
+            lock_guard<mutex> guard(controlLock);
+            stopRequested = true; // Input ended before the program did
+        }
+        controlChanged.notify_all();
+        executor.join();
+        renderer.join();
+    }
+
+    void display_status() {
+        cout << "\nRegisters Status:\n";
+        for (int i = 0; i < cpu.registers.size(); ++i) {
+            cout << "Register[" << i << "] = " << hex_byte(cpu.registers[i].get_value()) << endl;
+        }
+
+        cout << "\nMemory Status:\n";
+        memory.display(); // Show only non-empty memory cells
+
+        // Memory[00] holds the last character written to the screen by 3R00
+        uint8_t value = memory.read(0);
+        if (value == 0x20) {
+            cout << "Expected value: <space>" << endl; // Explicitly display a space character
+        } else if (value != 0 && value <= 127) { // ASCII range check
+            cout << "Expected value: " << static_cast<char>(value) << endl;
+        } else if (value != 0) {
+            cout << "Expected value: Non-printable ASCII character." << endl;
+        } else {
+            cout << "Memory[00] contains default value '00'." << endl;
+        }
+
+        cout << "Program Counter = " << cpu.programCounter << endl;
+    }
+
+
+    void manual_input() {
+        int startAddress;
+        cout << "Enter the starting memory address to store instructions: ";
+        cin >> startAddress;
+
+        string instruction;
+        cout << "Enter instructions (4 characters each, or 'C000' to finish): \n";
+        int address = startAddress;
+        while (cout << "Instruction: " && cin >> instruction) {
+            if (instruction.length() != 4) {
+                cout << "Invalid instruction length. Instructions must be 4 characters long.\n";
+                continue;
+            }
+            const DecodeEntry *entry = store_instruction(address, instruction);
+            if (!entry) {
+                if (!store_data(address, instruction)) {
+                    cout << "Invalid instruction: " << instruction << endl;
+                    continue;
+                }
+                cout << "Invalid opcode: " << instruction[0] << ". Stored as data at Memory[" << address << "]." << endl;
+                address += 2;
+                continue;
+            }
+            if (entry->opcode == Opcode::Halt) {
+                cout << "HALT instruction added at Memory[" << address << "]. Stopping instruction input.\n";
+                break;
+            }
+            cout << "Instruction '" << instruction << "' added at Memory[" << address << "]." << endl;
+            address += 2;
+        }
+        cpu.programCounter = startAddress; // Execution begins at the first stored instruction
+    }
+
+
+
+    void menu() {
+        int choice;
+        do {
+            cout << "\n1. Load Program\n2. Run\n3. Display Status\n4. Enter Instructions Manually\n5. Exit\n"
+                 << "6. Run With Live View\nChoice: ";
+            cin >> choice;
+            switch (choice) {
+                case 1: {
+                    string filename;
+                    cout << "Enter program file path: ";
+                    cin >> filename;
+                    load_program(filename);
+                    break;
+                }
+                case 2: run(); break;
+                case 3: display_status(); break;
+                case 4: {
+                    manual_input();
+                    run();
+                    break;
+                }
+                case 5: cout << "Exiting...\n"; break;
+                case 6: run_watched(10); break;
+                default: cout << "Invalid choice.\n"; break;
+            }
+        } while (choice != 5);
+    }
+    void load_program(const string &filename) {
+        ifstream file(filename);
+        if (!file.is_open()) {
+            cout << "Error: Unable to open file. Please check the file path and try again.\n";
+            return;
+        }
+
+        cout << "File loaded successfully.\n";
+        int startAddress;
+        cout << "Enter the starting memory address to store instructions: ";
+        cin >> startAddress;
+        load_words(file, startAddress);
+    }
+
+    // Copies a program image of count bytes to startAddress, with optional initial registers, and
+    // points the program counter at it. Its instructions are decoded on first fetch.
+    void load_image(int startAddress, const uint8_t *bytes, size_t count, const uint8_t *initialRegisters) {
+        for (size_t i = 0; i < count; ++i) memory.write(startAddress + i, bytes[i]);
+        cpu.rejectedLoops.fill(0);
+        for (int i = 0; initialRegisters && i < 16; ++i) cpu.registers[i].load_value(initialRegisters[i]);
+        cpu.programCounter = startAddress;
+    }
+
+    // Decodes and stores whitespace-separated instruction words from in, starting at startAddress
+    // and stopping after the first HALT. Hex words that are not valid instructions are stored as
+    // data in their place. Problems with the input are reported on log, and words that could not
+    // be stored at all are counted in skipped. Returns the address just past the last word stored.
+    int load_words(istream &in, int startAddress, ostream &log = cout, int *skipped = nullptr) {
+        string instruction;
+        int address = startAddress;
+        while (in >> instruction) {
+            if (instruction.length() != 4) {
+                log << "Skipping invalid instruction in file: " << instruction << endl;
+                if (skipped) ++*skipped;
+                continue;
+            }
+            const DecodeEntry *entry = store_instruction(address, instruction);
+            if (!entry) {
+                if (!store_data(address, instruction)) {
+                    log << "Skipping invalid instruction in file: " << instruction << endl;
+                    if (skipped) ++*skipped;
+                    continue;
+                }
+                log << "Invalid opcode in file: " << instruction[0] << ". Stored as data at Memory[" << address << "].\n";
+                address += 2;
+                continue;
+            }
+            address += 2;
+            if (entry->opcode == Opcode::Halt) {
+                log << "HALT instruction found. Stopping program loading at Memory[" << address - 2 << "].\n";
+                break;
+            }
+        }
+        cpu.programCounter = startAddress; // Execution begins at the first loaded instruction
+        cpu.rejectedLoops.fill(0);
+        return address;
+    }
+};
+
+// A register (R0-RF) or memory cell (M00-MFF) named on the command line
+struct SweepTarget {
+    string name;
+    bool isRegister = false;
+    int index = 0;
+};
+
+struct SweepRange {
+    SweepTarget target;
+    int from = 0;
+    int to = 0;
+};
+
+bool parse_sweep_target(const string &text, SweepTarget &target) {
+    if (text.length() < 2) return false;
+    char kind = toupper(text[0]);
+    int index = parse_hex(text.substr(1));
+    if ((kind != 'R' && kind != 'M') || index < 0 || index > (kind == 'R' ? 0xF : 0xFF)) return false;
+    target.name = text;
+    target.isRegister = kind == 'R';
+    target.index = index;
+    return true;
+}
+
+// Parses "M40=00:FF" or "R1=3" (a single value)
+bool parse_sweep_range(const string &text, SweepRange &range) {
+    size_t equals = text.find('=');
+    if (equals == string::npos || !parse_sweep_target(text.substr(0, equals), range.target)) return false;
+    string bounds = text.substr(equals + 1);
+    size_t colon = bounds.find(':');
+    range.from = parse_hex(bounds.substr(0, colon));
+    range.to = colon == string::npos ? range.from : parse_hex(bounds.substr(colon + 1));
+    return range.from >= 0 && range.to >= range.from && range.to <= 0xFF;
+}
+
+// Largest number of combinations a sweep runs: three full byte ranges
+constexpr size_t maxSweepPoints = size_t(1) << 24;
+
+// Number of combinations of ranges, or maxSweepPoints + 1 if there are more than maxSweepPoints
+size_t sweep_points(const vector<SweepRange> &ranges) {
+    size_t points = 1;
+    for (const SweepRange &range : ranges) {
+        points *= range.to - range.from + 1;
+        if (points > maxSweepPoints) return maxSweepPoints + 1;
+    }
+    return points;
+}
+
+// Runs one shared program for every combination of the swept inputs. Results are kept
+// column-major: one byte column per swept input, one per observed target, then whether the
+// run halted before the step limit. With cycle costs every run is also timed, and the modelled
+// cycles, stalls and cache hit rate are kept per run.
+class Sweep {
+private:
+    shared_ptr<const Program> program;
+    vector<SweepRange> ranges;
+    vector<SweepTarget> observed;
+    long long maxSteps;
+    vector<string> names;
+    vector<vector<uint8_t>> columns;
+    const CycleCosts *costs;
+    vector<long long> cycles, stalls;
+    vector<double> hitRates;
+
+    void run_point(Machine &machine, size_t point) {
+        machine.reset();
+        size_t remaining = point;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            const SweepRange &range = ranges[i];
+            size_t span = range.to - range.from + 1;
+            int value = range.from + remaining % span;
+            remaining /= span;
+            if (range.target.isRegister) machine.set_register(range.target.index, value);
+            else machine.set_cell(range.target.index, value);
+            columns[i][point] = value;
+        }
+        machine.run_silent(maxSteps);
+        for (size_t i = 0; i < observed.size(); ++i) {
+            const SweepTarget &target = observed[i];
+            columns[ranges.size() + i][point] = target.isRegister ? machine.register_value(target.index)
+                                                                  : machine.cell_value(target.index);
+        }
+        columns.back()[point] = machine.halted();
+        if (const CycleModel *model = machine.cycle_model()) {
+            cycles[point] = model->cycles;
+            stalls[point] = model->stalls;
+            hitRates[point] = model->hit_rate();
+        }
+    }
+
+public:
+    Sweep(shared_ptr<const Program> shared, vector<SweepRange> swept, vector<SweepTarget> watched, long long limit,
+          const CycleCosts *timing = nullptr)
+        : program(move(shared)), ranges(move(swept)), observed(move(watched)), maxSteps(limit), costs(timing) {
+        size_t points = sweep_points(ranges);
+        for (const SweepRange &range : ranges) names.push_back(range.target.name);
+        for (const SweepTarget &target : observed) names.push_back(target.name);
+        names.push_back("halted");
+        columns.assign(names.size(), vector<uint8_t>(points));
+        if (costs) {
+            cycles.resize(points);
+            stalls.resize(points);
+            hitRates.resize(points);
+        }
+    }
+
+    size_t points() const { return columns.back().size(); }
+
+    // Worker threads claim blocks of points; every point writes only its own row
+    void run(int threads) {
+        atomic<size_t> next(0);
+        const size_t block = 64;
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&]() {
+                Machine machine(program);
+                machine.set_timing(costs);
+                for (size_t begin = next.fetch_add(block); begin < points(); begin = next.fetch_add(block)) {
+                    for (size_t point = begin; point < min(begin + block, points()); ++point) {
+                        run_point(machine, point);
+                    }
+                }
+            });
+        }
+        for (thread &worker : workers) worker.join();
+    }
+
+    // Timed sweeps end each row with cycles, stalls and hit_rate, the last empty without a cache
+    void write_csv(ostream &out) const {
+        for (size_t c = 0; c < names.size(); ++c) out << (c ? "," : "") << names[c];
+        out << (costs ? ",cycles,stalls,hit_rate\n" : "\n");
+        for (size_t row = 0; row < points(); ++row) {
+            for (size_t c = 0; c < columns.size(); ++c) out << (c ? "," : "") << int(columns[c][row]);
+            if (costs) {
+                out << "," << cycles[row] << "," << stalls[row] << ",";
+                if (hitRates[row] >= 0) out << fixed << setprecision(1) << hitRates[row] << defaultfloat;
+            }
+            out << "\n";
+        }
+    }
+
+    // "VSWP", column count (uint32), row count (uint64), each column name as a length byte and
+    // its characters, then each column's bytes in turn. Integers are little-endian. Every column
+    // is a byte wide, so timing results are only written as CSV.
+    void write_binary(ostream &out) const {
+        uint32_t columnCount = columns.size();
+        uint64_t rowCount = points();
+        out.write("VSWP", 4);
+        for (int i = 0; i < 4; ++i) out.put(static_cast<char>(columnCount >> (8 * i)));
+        for (int i = 0; i < 8; ++i) out.put(static_cast<char>(rowCount >> (8 * i)));
+        for (const string &name : names) {
+            out.put(static_cast<char>(name.length()));
+            out.write(name.data(), name.length());
+        }
+        for (const vector<uint8_t> &column : columns) {
+            out.write(reinterpret_cast<const char *>(column.data()), column.size());
+        }
+    }
+};
+
+int run_sweep(int argc, char *argv[]) {
+    string filename = argc > 2 ? argv[2] : "";
+    string output;
+    bool binary = false;
+    int startAddress = 0;
+    long long maxSteps = 100000;
+    int threads = max(1u, thread::hardware_concurrency());
+    vector<SweepRange> ranges;
+    vector<SweepTarget> observed;
+    CycleCosts costs;
+    bool timing = false;
+    string error;
+
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        bool valid = !value.empty();
+        if (option == "--binary") {
+            binary = true;
+            continue;
+        } else if (option == "--start") {
+            startAddress = parse_hex(value);
+            valid = valid && startAddress >= 0 && startAddress < 0xFF;
+        } else if (option == "--vary") {
+            SweepRange range;
+            valid = valid && parse_sweep_range(value, range);
+            ranges.push_back(range);
+        } else if (option == "--observe") {
+            stringstream list(value);
+            string name;
+            while (valid && getline(list, name, ',')) {
+                SweepTarget target;
+                valid = parse_sweep_target(name, target);
+                observed.push_back(target);
+            }
+        } else if (option == "--steps") {
+            maxSteps = atoll(value.c_str());
+            valid = valid && maxSteps > 0;
+        } else if (option == "--threads") {
+            threads = atoi(value.c_str());
+            valid = valid && threads > 0;
+        } else if (option == "--out") {
+            output = value;
+        } else if (option == "--timing") {
+            timing = valid = valid && costs.parse(value, error);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            cout << "Invalid sweep option: " << option << " " << value << (error.empty() ? "" : " (" + error + ")") << endl;
+            return 1;
+        }
+        ++i;
+    }
+
+    ifstream file(filename);
+    if (!file.is_open() || ranges.empty() || sweep_points(ranges) > maxSweepPoints || (timing && binary)) {
+        cout << "Usage: " << argv[0] << " --sweep <program file> --vary <Rr|Mxx>=<from>:<to> [--vary ...]\n"
+             << "       [--observe <Rr|Mxx>,...] [--start <address>] [--steps <limit>] [--threads <count>]\n"
+             << "       [--out <file>] [--binary | --timing <costs>]\n"
+             << "Registers, addresses and values are hex; every combination of the --vary ranges is run,\n"
+             << "at most " << maxSweepPoints << " combinations.\n";
+        return 1;
+    }
+
+    Machine loader;
+    loader.load_words(file, startAddress, cerr);
+    Sweep sweep(loader.share_program(), ranges, observed, maxSteps, timing ? &costs : nullptr);
+    sweep.run(threads);
+
+    ofstream outFile;
+    if (!output.empty()) {
+        outFile.open(output, binary ? ios::binary : ios::out);
+        if (!outFile.is_open()) {
+            cout << "Error: Unable to open output file " << output << endl;
+            return 1;
+        }
+    }
+    ostream &out = output.empty() ? cout : outFile;
+    if (binary) sweep.write_binary(out);
+    else sweep.write_csv(out);
+    return 0;
+}
+
+// Several Cpus running one program against a single shared Memory, each on its own host thread
+// or interleaved on one thread in a seeded, reproducible order. Every Cpu starts with its index
+// in RF and may use the CAS extension opcode.
+class Multiprocessor {
+private:
+    Memory memory;
+    shared_ptr<const Program> program;
+    vector<Cpu> cpus;
+    vector<long long> executed;
+
+public:
+    Multiprocessor(shared_ptr<const Program> shared, const vector<int> &entries)
+        : memory(shared->image), program(move(shared)), cpus(entries.size()), executed(entries.size()) {
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            cpus[i].programCounter = entries[i];
+            cpus[i].registers[0xF].load_value(i);
+            cpus[i].extensions = true;
+        }
+    }
+
+    // Runs every Cpu on its own host thread until it halts or has executed maxSteps instructions.
+    // A fence between instructions makes each guest load an acquire and each guest store a
+    // release, so a lock taken with CAS and released with a plain STORE orders the accesses it
+    // protects. On x86 the fence costs nothing.
+    void run_threads(long long maxSteps) {
+        vector<thread> threads;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            threads.emplace_back([this, i, maxSteps]() {
+                long long steps = 0;
+                while (steps < maxSteps && cpus[i].step(memory, program.get(), nullptr)) {
+                    atomic_thread_fence(memory_order_acq_rel);
+                    ++steps;
+                }
+                executed[i] = steps;
+            });
+        }
+        for (thread &worker : threads) worker.join();
+    }
+
+    // Steps one Cpu at a time, chosen by a generator seeded with seed, so the same seed always
+    // reproduces the same interleaving
+    void run_interleaved(long long maxSteps, uint32_t seed) {
+        mt19937 schedule(seed);
+        vector<size_t> running(cpus.size());
+        iota(running.begin(), running.end(), 0);
+        while (!running.empty()) {
+            size_t pick = schedule() % running.size();
+            size_t i = running[pick];
+            if (executed[i] < maxSteps && cpus[i].step(memory, program.get(), nullptr)) {
+                ++executed[i];
+            } else {
+                running.erase(running.begin() + pick);
+            }
+        }
+    }
+
+    void display_status() {
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            const Cpu &cpu = cpus[i];
+            cout << "CPU " << dec << i << ": " << executed[i] << " instructions, "
+                 << (cpu.programCounter == -1 ? "halted" : "stopped at Memory[" + to_string(cpu.programCounter) + "]")
+                 << "\n  Registers:";
+            for (const Register &reg : cpu.registers) cout << " " << hex_byte(reg.get_value());
+            cout << "\n";
+        }
+        memory.display();
+    }
+};
+
+int run_multiprocessor(int argc, char *argv[]) {
+    string filename = argc > 2 ? argv[2] : "";
+    int cpuCount = 2;
+    int startAddress = 0;
+    long long maxSteps = 10000000;
+    bool deterministic = false;
+    uint32_t seed = 0;
+    vector<int> entries;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--cpus" && atoi(value.c_str()) > 0) {
+            cpuCount = atoi(value.c_str());
+        } else if (option == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+            startAddress = parse_hex(value);
+        } else if (option == "--entries" && !value.empty()) {
+            stringstream list(value);
+            string entry;
+            while (getline(list, entry, ',')) entries.push_back(parse_hex(entry));
+        } else if (option == "--steps" && atoll(value.c_str()) > 0) {
+            maxSteps = atoll(value.c_str());
+        } else if (option == "--seed" && !value.empty()) {
+            deterministic = true;
+            seed = strtoul(value.c_str(), nullptr, 10);
+        } else {
+            filename.clear();
+            break;
+        }
+        ++i;
+    }
+
+    ifstream file(filename);
+    bool validEntries = all_of(entries.begin(), entries.end(), [](int entry) { return entry >= 0 && entry < 0xFF; });
+    if (!file.is_open() || !validEntries) {
+        cout << "Usage: " << argv[0] << " --multi <program file> [--cpus <count>] [--entries <address>,...]\n"
+             << "       [--start <address>] [--steps <limit per cpu>] [--seed <number>]\n"
+             << "Each cpu starts at its entry (default: the start address) with its index in RF.\n"
+             << "With --seed the cpus are interleaved on one thread in a reproducible order.\n";
+        return 1;
+    }
+    if (entries.empty()) entries.assign(cpuCount, startAddress);
+
+    Machine loader;
+    loader.enable_extensions();
+    loader.load_words(file, startAddress, cerr);
+    Multiprocessor machines(loader.share_program(), entries);
+    if (deterministic) machines.run_interleaved(maxSteps, seed);
+    else machines.run_threads(maxSteps);
+    machines.display_status();
+    return 0;
+}
+
+// Bounded single-producer/single-consumer ring buffer. The producer only writes tail and the
+// consumer only writes head, so neither side ever takes a lock.
+template <typename T, size_t Capacity>
+class SpscQueue {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    array<T, Capacity> slots;
+    alignas(64) atomic<size_t> head{0}; // Next slot to pop
+    alignas(64) atomic<size_t> tail{0}; // Next slot to push
+
+public:
+    bool try_push(T &value) {
+        size_t position = tail.load(memory_order_relaxed);
+        if (position - head.load(memory_order_acquire) == Capacity) return false;
+        slots[position & (Capacity - 1)] = move(value);
+        tail.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &value) {
+        size_t position = head.load(memory_order_relaxed);
+        if (position == tail.load(memory_order_acquire)) return false;
+        value = move(slots[position & (Capacity - 1)]);
+        head.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    // Only meaningful to the consumer and to the producer respectively
+    bool empty() const { return head.load(memory_order_acquire) == tail.load(memory_order_acquire); }
+    bool full() const { return tail.load(memory_order_acquire) - head.load(memory_order_acquire) == Capacity; }
+};
+
+// Reads instruction words from a stream on a producer thread, parsing them and looking them up in
+// the decode table as they arrive, and hands them to the executing machine through a bounded
+// queue. The machine only waits when the word at its program counter, or a cell a LOAD, STORE or
+// CAS there accesses, has not arrived yet, so it ends as if the whole stream had been loaded first.
+class StreamLoader {
+private:
+    struct StreamedWord {
+        int address = 0;
+        int first = 0;
+        int second = 0;
+        const DecodeEntry *entry = nullptr; // nullptr for a word that is stored as data
+    };
+
+    SpscQueue<StreamedWord, 64> queue;
+    int firstAddress;           // Cells below it are never streamed
+    atomic<bool> finished{false};
+    atomic<bool> stopRequested{false};
+    array<bool, 256> present{}; // Cells already placed in the machine's memory
+    array<int, 2> wakeup;       // Pipe the destructor writes to, waking a producer waiting for input
+    mutex waitLock;             // Guards nothing; lets a side block until the other signals
+    condition_variable changed; // Signalled after every push and pop, at the end and on stop
+    thread producer;            // Declared last so it starts after the queue and pipe exist
+
+    static array<int, 2> make_pipe() {
+        array<int, 2> ends{-1, -1};
+        if (pipe(ends.data()) < 0) ends = {-1, -1};
+        return ends;
+    }
+
+    // Wakes the other side if it is blocked in await
+    void signal() {
+        { lock_guard<mutex> guard(waitLock); }
+        changed.notify_all();
+    }
+
+    // Returns once ready() holds. Spins briefly, since the other side is usually about to make it
+    // true, and then blocks until signalled.
+    template <typename Ready>
+    void await(Ready ready) {
+        for (int spin = 0; spin < 100; ++spin) {
+            if (ready()) return;
+            this_thread::yield();
+        }
+        unique_lock<mutex> guard(waitLock);
+        changed.wait(guard, ready);
+    }
+
+    // Reads the next whitespace-separated word from fd. Returns false at the end of the input, or
+    // as soon as the destructor asks the producer to stop, even while no input is arriving.
+    bool next_word(int fd, string &pending, string &word) {
+        while (true) {
+            size_t begin = pending.find_first_not_of(" \t\r\n");
+            size_t end = begin == string::npos ? string::npos : pending.find_first_of(" \t\r\n", begin);
+            if (end != string::npos) {
+                word = pending.substr(begin, end - begin);
+                pending.erase(0, end);
+                return true;
+            }
+            pollfd fds[2] = {{fd, POLLIN, 0}, {wakeup[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (fds[1].revents) return false;
+            char chunk[4096];
+            ssize_t received = read(fd, chunk, sizeof(chunk));
+            if (received <= 0) {
+                // End of input: the last word needs no whitespace after it
+                if (begin == string::npos) return false;
+                word = pending.substr(begin);
+                pending.clear();
+                return true;
+            }
+            pending.append(chunk, received);
+        }
+    }
+
+    void produce(int fd, int startAddress, ostream &log) {
+        string instruction, pending;
+        int address = startAddress;
+        while (!stopRequested.load(memory_order_relaxed) && address + 1 < 256 && next_word(fd, pending, instruction)) {
+            StreamedWord word;
+            word.entry = decode_word(instruction, word.first, word.second);
+            if (!word.entry && (instruction.length() != 4 || word.first < 0 || word.second < 0)) {
+                log << "Skipping invalid instruction in stream: " << instruction << endl;
+                continue;
+            }
+            if (!word.entry) {
+                log << "Invalid opcode in stream: " << instruction[0] << ". Stored as data at Memory[" << address << "]." << endl;
+            }
+            word.address = address;
+            while (!queue.try_push(word)) {
+                if (stopRequested.load(memory_order_relaxed)) break;
+                // The queue is full: the machine has not caught up
+                await([this]() { return !queue.full() || stopRequested.load(memory_order_relaxed); });
+            }
+            signal();
+            if (word.entry && word.entry->opcode == Opcode::Halt) break; // Loading a file stops there too
+            address += 2;
+        }
+        finished.store(true, memory_order_release);
+        signal();
+    }
+
+public:
+    // Streams instruction words read from the file descriptor fd
+    StreamLoader(int fd, int startAddress, ostream &log)
+        : firstAddress(startAddress), wakeup(make_pipe()), producer(&StreamLoader::produce, this, fd, startAddress, ref(log)) {}
+
+    ~StreamLoader() {
+        stopRequested.store(true, memory_order_relaxed);
+        signal();                           // The producer may be waiting for room in the queue
+        if (write(wakeup[1], "", 1) < 0) {} // or for input that never comes
+        producer.join();
+        close(wakeup[0]);
+        close(wakeup[1]);
+    }
+
+    // Places streamed words into the machine until the cells [address, address + count) are
+    // present or the stream has ended
+    void wait_for(Machine &machine, int address, int count = 2) {
+        while (address >= firstAddress && address + count <= 256 &&
+               !all_of(present.begin() + address, present.begin() + address + count, [](bool placed) { return placed; })) {
+            bool done = finished.load(memory_order_acquire);
+            StreamedWord word;
+            if (queue.try_pop(word)) {
+                if (word.entry) {
+                    machine.place_instruction(word.address, *word.entry, word.first, word.second);
+                } else {
+                    machine.set_cell(word.address, word.first);
+                    machine.set_cell(word.address + 1, word.second);
+                }
+                present[word.address] = present[word.address + 1] = true;
+                signal();
+            } else if (done) {
+                return;
+            } else {
+                await([this]() { return !queue.empty() || finished.load(memory_order_acquire); });
+            }
+        }
+    }
+
+    // Waits for the word at address and for the memory cell it reads or writes, if any. A LOAD
+    // from a cell still in the queue would read 0, and a STORE to it would be overwritten later.
+    void wait_for_instruction(Machine &machine, int address) {
+        wait_for(machine, address);
+        if (address < 0 || address + 1 >= 256) return;
+        switch (decodeTable[machine.cell_value(address)].opcode) {
+            case Opcode::LoadFromMemory:
+            case Opcode::StoreToMemory:
+            case Opcode::CompareAndSwap: wait_for(machine, machine.cell_value(address + 1), 1); break;
+            default: break;
+        }
+    }
+};
+
+int run_stream(int argc, char *argv[]) {
+    int startAddress = 0;
+    long long maxSteps = LLONG_MAX;
+    bool trace = false;
+    for (int i = 2; i < argc; ++i) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--trace") {
+            trace = true;
+        } else if (option == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+            startAddress = parse_hex(value);
+            ++i;
+        } else if (option == "--steps" && atoll(value.c_str()) > 0) {
+            maxSteps = atoll(value.c_str());
+            ++i;
+        } else {
+            cout << "Usage: " << argv[0] << " --stream [--start <address>] [--steps <limit>] [--trace]\n"
+                 << "Instruction words are read from standard input and run as soon as they arrive.\n";
+            return 1;
+        }
+    }
+
+    Machine machine;
+    machine.jump_to(startAddress);
+    {
+        StreamLoader stream(STDIN_FILENO, startAddress, cerr);
+        for (long long steps = 0; steps < maxSteps; ++steps) {
+            stream.wait_for_instruction(machine, machine.program_counter());
+            if (!machine.step(trace ? &cout : nullptr)) break;
+        }
+    }
+    machine.display_status();
+    return 0;
+}
+
+// Execution counts gathered while a guest program runs: per address, per conditional jump
+// outcome, and per back-edge (a taken jump to an address at or before itself), each back-edge
+// marking a loop.
+class Profiler {
+private:
+    array<uint64_t, 256> executions{};
+    array<uint64_t, 256> taken{};
+    array<uint64_t, 256> notTaken{};
+    map<pair<int, int>, uint64_t> backEdges; // (loop head, jump address) -> times taken
+    uint64_t total = 0;
+
+    // Loops containing address, outermost first
+    vector<pair<int, int>> loops_containing(int address) const {
+        vector<pair<int, int>> loops;
+        for (const auto &edge : backEdges) {
+            if (edge.first.first <= address && address <= edge.first.second) loops.push_back(edge.first);
+        }
+        sort(loops.begin(), loops.end(), [](const pair<int, int> &a, const pair<int, int> &b) {
+            return a.second - a.first > b.second - b.first;
+        });
+        return loops;
+    }
+
+public:
+    // Records one executed instruction: its address, first byte, and the program counter after it
+    void record(int pc, int first, int nextPc) {
+        ++executions[pc];
+        ++total;
+        Opcode opcode = decodeTable[first].opcode;
+        if (opcode != Opcode::JumpIfEqual && opcode != Opcode::JumpIfGreater) return;
+        if (nextPc == pc + 2) {
+            ++notTaken[pc];
+        } else {
+            ++taken[pc];
+            if (nextPc <= pc) ++backEdges[{nextPc, pc}];
+        }
+    }
+
+    // Annotated listing of [start, end) plus any other executed address, the hot loops, and a
+    // heat grid laid out like Memory::display
+    void report(Machine &machine, int start, int end, ostream &out) const {
+        out << "\nProfile: " << total << " instructions executed\n\n";
+        out << "Addr Word      Count      %  Instruction\n";
+        for (int address = 0; address + 1 < 256; ++address) {
+            bool loaded = address >= start && address < end && (address - start) % 2 == 0;
+            if (!loaded && executions[address] == 0) continue;
+            int first = machine.cell_value(address), second = machine.cell_value(address + 1);
+            double share = total ? 100.0 * executions[address] / total : 0;
+            out << " " << hex_byte(address) << "  " << hex_byte(first) << hex_byte(second)
+                << setfill(' ') << dec << setw(11) << executions[address]
+                << setw(6) << fixed << setprecision(1) << share << "%  ";
+            stringstream notes;
+            if (taken[address] || notTaken[address]) {
+                notes << " taken " << taken[address] << ", not taken " << notTaken[address];
+            }
+            for (const auto &edge : backEdges) {
+                if (edge.first.first == address) notes << " <- loop head";
+            }
+            if (notes.str().empty()) out << disassemble(first, second) << "\n";
+            else out << left << setw(20) << disassemble(first, second) << right << notes.str() << "\n";
+        }
+
+        out << "\nHot loops:\n";
+        if (backEdges.empty()) out << "  none\n";
+        vector<pair<uint64_t, pair<int, int>>> loops;
+        for (const auto &edge : backEdges) loops.push_back({edge.second, edge.first});
+        sort(loops.rbegin(), loops.rend());
+        for (const auto &loop : loops) {
+            uint64_t bodyExecutions = 0;
+            for (int address = loop.second.first; address <= loop.second.second; ++address) {
+                bodyExecutions += executions[address];
+            }
+            out << "  " << hex_byte(loop.second.first) << "-" << hex_byte(loop.second.second) << ": back-edge taken "
+                << dec << loop.first << " times, " << bodyExecutions << " instructions executed in the body\n";
+        }
+
+        // Each cell shows its share of the hottest address's count, 01-99, or " ." if never run
+        uint64_t hottest = *max_element(executions.begin(), executions.end());
+        out << "\nHeat Map (% of hottest address):\n";
+        out << "      ";
+        for (int j = 0; j < 16; j++) {
+            out << " " << hex << uppercase << j << " ";
+        }
+        out << "\n     ------------------------------------------------\n";
+        for (int i = 0; i < 256; i++) {
+            if (i % 16 == 0) out << hex_byte(i / 16) << " | ";
+            if (executions[i] == 0) {
+                out << " . ";
+            } else {
+                int heat = max<int>(1, min<uint64_t>(99, executions[i] * 99 / hottest));
+                out << dec << setw(2) << setfill('0') << heat << " ";
+            }
+            if ((i + 1) % 16 == 0) out << "\n";
+        }
+        out << dec << setfill(' ');
+    }
+
+    // Collapsed stacks for flamegraph tools: program, then each enclosing loop, then the
+    // instruction, followed by its execution count
+    void write_collapsed(Machine &machine, ostream &out) const {
+        for (int address = 0; address < 256; ++address) {
+            if (executions[address] == 0) continue;
+            out << "vole";
+            for (const auto &loop : loops_containing(address)) {
+                out << ";loop " << hex_byte(loop.first) << "-" << hex_byte(loop.second);
+            }
+            out << ";" << hex_byte(address) << " "
+                << disassemble(machine.cell_value(address), machine.cell_value(address + 1))
+                << " " << dec << executions[address] << "\n";
+        }
+    }
+};
+
+int run_profile(int argc, char *argv[]) {
+    string filename = argc > 2 ? argv[2] : "";
+    string flamegraph;
+    int startAddress = 0;
+    long long maxSteps = LLONG_MAX;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+            startAddress = parse_hex(value);
+        } else if (option == "--steps" && atoll(value.c_str()) > 0) {
+            maxSteps = atoll(value.c_str());
+        } else if (option == "--flamegraph" && !value.empty()) {
+            flamegraph = value;
+        } else {
+            filename.clear();
+            break;
+        }
+        ++i;
+    }
+
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cout << "Usage: " << argv[0] << " --profile <program file> [--start <address>] [--steps <limit>]\n"
+             << "       [--flamegraph <collapsed stack file>]\n";
+        return 1;
+    }
+
+    Machine machine;
+    int end = machine.load_words(file, startAddress);
+    Profiler profiler;
+    for (long long steps = 0; steps < maxSteps; ++steps) {
+        int pc = machine.program_counter();
+        int first = machine.cell_value(pc);
+        if (!machine.step(nullptr)) break;
+        profiler.record(pc, first, machine.program_counter());
+    }
+    profiler.report(machine, startAddress, end, cout);
+
+    if (!flamegraph.empty()) {
+        ofstream out(flamegraph);
+        if (!out.is_open()) {
+            cout << "Error: Unable to open output file " << flamegraph << endl;
+            return 1;
+        }
+        profiler.write_collapsed(machine, out);
+    }
+    return 0;
+}
+
+// Removes a socket left behind at path by an earlier server so it can be bound again. Anything
+// else at path is left alone and reported as a failure.
+bool remove_stale_socket(const string &path) {
+    struct stat status;
+    if (lstat(path.c_str(), &status) < 0) return errno == ENOENT;
+    if (!S_ISSOCK(status.st_mode)) {
+        errno = EEXIST;
+        return false;
+    }
+    return unlink(path.c_str()) == 0;
+}
+
+// One client of the daemon. Lines for it, results from any worker and errors from its reader,
+// wait in an outbox that a writer thread of its own sends, so no worker ever blocks on a slow
+// client's socket. The reader takes a slot for every line before causing it and the writer gives
+// the slot back once the line is sent, which bounds the outbox and stops the reader while the
+// client is not reading results. The socket closes once the reader and every queued job have let
+// go of it.
+class DaemonConnection {
+private:
+    int fd;
+    mutex outboxLock;
+    condition_variable outboxChanged;
+    deque<string> outbox;
+    size_t unsent = 0;     // Lines taken a slot for and not yet sent
+    bool finished = false; // The reader is done and every line has been sent
+    bool broken = false;   // A send failed: the client went away and later lines are dropped
+
+public:
+    static const size_t outboxCapacity = 256;
+
+    explicit DaemonConnection(int socket) : fd(socket) {}
+    ~DaemonConnection() { close(fd); }
+
+    // Waits for room for one more line from this client's jobs or reader
+    void take_slot() {
+        unique_lock<mutex> guard(outboxLock);
+        outboxChanged.wait(guard, [this]() { return unsent < outboxCapacity; });
+        ++unsent;
+    }
+
+    // Queues a line in a slot taken before; never blocks on the socket
+    void send_line(const string &line) {
+        {
+            lock_guard<mutex> guard(outboxLock);
+            outbox.push_back(line + "\n");
+        }
+        outboxChanged.notify_all();
+    }
+
+    // Sends queued lines until finish is called and every slot has been given back
+    void write_lines() {
+        unique_lock<mutex> guard(outboxLock);
+        while (true) {
+            outboxChanged.wait(guard, [this]() { return !outbox.empty() || finished; });
+            if (outbox.empty()) return;
+            string data = move(outbox.front());
+            outbox.pop_front();
+            guard.unlock();
+            for (size_t sent = 0; sent < data.size() && !broken;) {
+                ssize_t written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (written <= 0) broken = true; // Only this thread reads or writes it
+                else sent += written;
+            }
+            guard.lock();
+            --unsent;
+            outboxChanged.notify_all();
+        }
+    }
+
+    // Called by the reader when the client has stopped sending: waits for the results of the
+    // client's queued jobs and then lets write_lines return
+    void finish() {
+        unique_lock<mutex> guard(outboxLock);
+        outboxChanged.wait(guard, [this]() { return unsent == 0; });
+        finished = true;
+        outboxChanged.notify_all();
+    }
+
+    // Reads one newline-terminated line; false once the client has closed the connection
+    bool read_line(string &buffer, string &line) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) == string::npos) {
+            char chunk[4096];
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) return false;
+            buffer.append(chunk, received);
+        }
+        line = buffer.substr(0, newline);
+        buffer.erase(0, newline + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+};
+
+struct DaemonJob {
+    shared_ptr<DaemonConnection> client;
+    string id;
+    string words; // Program words, space-separated
+    int startAddress = 0;
+    long long maxSteps = 0;
+    int timeoutMs = 0;
+    vector<pair<SweepTarget, int>> initialState;
+    bool timed = false;
+    CycleCosts costs;
+};
+
+// Long-lived job server on a Unix domain socket. Each client sends one line per job:
+//
+//   JOB id=<name> program=<word>,<word>,... [start=<hex>] [steps=<n>] [timeout=<ms>] [set=R1:05,M40:FF]
+//       [timing=<costs>]
+//
+// and gets back, in completion order,
+//
+//   RESULT id=<name> status=halted|limit|timeout|invalid steps=<n> pc=<hex> regs=<32 hex> mem=<512 hex>
+//       [cycles=<n> stalls=<n> [hit_rate=<percent>]]
+//
+// Costs are given as for --timing, e.g. timing=ADDF=4,memory=10,lines=8; a timed job's result
+// has its modelled cycles and stalls, and its cache hit rate when the costs include a cache.
+// Jobs wait in a bounded queue; while it is full, or while a client has
+// DaemonConnection::outboxCapacity results it has not read, that client's jobs are not read, so
+// the socket pushes back on the client. Workers take jobs in batches and keep their Machine and the decoded
+// programs of earlier jobs between jobs.
+class Daemon {
+private:
+    string socketPath;
+    long long defaultSteps;
+    int defaultTimeoutMs;
+    size_t queueCapacity;
+    deque<DaemonJob> queue;
+    mutex queueLock;
+    condition_variable jobsAvailable;
+    condition_variable spaceAvailable;
+    unordered_map<string, shared_ptr<const Program>> programs; // Keyed by start address and words
+    mutex programsLock;
+
+    static const size_t batchSize = 16;
+    static const size_t programCacheSize = 1024;
+
+    shared_ptr<const Program> decoded_program(const DaemonJob &job) {
+        string key = to_string(job.startAddress) + ":" + job.words;
+        {
+            lock_guard<mutex> guard(programsLock);
+            auto found = programs.find(key);
+            if (found != programs.end()) return found->second;
+        }
+        Machine loader;
+        stringstream words(job.words), log; // parse_job has checked every word, so only HALT is logged
+        loader.load_words(words, job.startAddress, log);
+        shared_ptr<const Program> program = loader.share_program();
+        lock_guard<mutex> guard(programsLock);
+        if (programs.size() >= programCacheSize) programs.clear();
+        programs[key] = program;
+        return program;
+    }
+
+    void run_job(Machine &machine, const DaemonJob &job) {
+        machine.use_program(decoded_program(job));
+        machine.set_timing(job.timed ? &job.costs : nullptr);
+        for (const auto &assignment : job.initialState) {
+            if (assignment.first.isRegister) machine.set_register(assignment.first.index, assignment.second);
+            else machine.set_cell(assignment.first.index, assignment.second);
+        }
+
+        // The deadline is checked between slices of instructions rather than on every step
+        const long long slice = 4096;
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(job.timeoutMs);
+        long long steps = 0;
+        bool timedOut = false;
+        while (steps < job.maxSteps) {
+            long long chunk = min(slice, job.maxSteps - steps);
+            long long executed = machine.run_silent(chunk);
+            steps += executed;
+            if (executed < chunk) break;
+            if (chrono::steady_clock::now() > deadline) {
+                timedOut = true;
+                break;
+            }
+        }
+
+        stringstream result;
+        result << "RESULT id=" << job.id << " status="
+               << (timedOut && !machine.halted() ? "timeout" : machine.stop_reason(steps, job.maxSteps))
+               << " steps=" << steps << " pc=" << hex_byte(machine.program_counter()) << " regs=";
+        for (int i = 0; i < 16; ++i) result << hex_byte(machine.register_value(i));
+        result << " mem=";
+        for (int i = 0; i < 256; ++i) result << hex_byte(machine.cell_value(i));
+        if (const CycleModel *model = machine.cycle_model()) {
+            result << " cycles=" << model->cycles << " stalls=" << model->stalls;
+            if (model->hit_rate() >= 0) result << " hit_rate=" << fixed << setprecision(1) << model->hit_rate();
+        }
+        machine.set_timing(nullptr); // The costs belong to the job
+        job.client->send_line(result.str());
+    }
+
+    void work() {
+        Machine machine;
+        vector<DaemonJob> batch;
+        while (true) {
+            {
+                unique_lock<mutex> guard(queueLock);
+                jobsAvailable.wait(guard, [this]() { return !queue.empty(); });
+                while (!queue.empty() && batch.size() < batchSize) {
+                    batch.push_back(move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            spaceAvailable.notify_all();
+            for (const DaemonJob &job : batch) run_job(machine, job);
+            batch.clear();
+        }
+    }
+
+    // Parses a JOB line; on failure returns false with the reason in error
+    bool parse_job(const string &line, DaemonJob &job, string &error) {
+        stringstream fields(line);
+        string field;
+        fields >> field;
+        if (field != "JOB") {
+            error = "expected JOB";
+            return false;
+        }
+        job.maxSteps = defaultSteps;
+        job.timeoutMs = defaultTimeoutMs;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            string key = field.substr(0, equals);
+            string value = equals == string::npos ? "" : field.substr(equals + 1);
+            if (key == "id") {
+                job.id = value;
+            } else if (key == "program") {
+                stringstream list(value);
+                string word;
+                int first, second;
+                while (getline(list, word, ',')) {
+                    // Every word must load, or the job would silently run a different program
+                    if (!decode_word(word, first, second)) {
+                        error = "bad word " + word;
+                        return false;
+                    }
+                    job.words += (job.words.empty() ? "" : " ") + word;
+                }
+            } else if (key == "start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+                job.startAddress = parse_hex(value);
+            } else if (key == "steps" && atoll(value.c_str()) > 0) {
+                job.maxSteps = atoll(value.c_str());
+            } else if (key == "timeout" && atoi(value.c_str()) > 0) {
+                job.timeoutMs = atoi(value.c_str());
+            } else if (key == "timing") {
+                if (!job.costs.parse(value, error)) return false;
+                job.timed = true;
+            } else if (key == "set") {
+                stringstream list(value);
+                string assignment;
+                while (getline(list, assignment, ',')) {
+                    SweepRange range;
+                    if (!parse_sweep_range(replace_colon(assignment), range) || range.from != range.to) {
+                        error = "bad assignment " + assignment;
+                        return false;
+                    }
+                    job.initialState.push_back({range.target, range.from});
+                }
+            } else {
+                error = "bad field " + field;
+                return false;
+            }
+        }
+        if (job.id.empty() || job.words.empty()) {
+            error = "id and program are required";
+            return false;
+        }
+        return true;
+    }
+
+    // "R1:05" -> "R1=05", the form parse_sweep_range takes
+    static string replace_colon(string assignment) {
+        size_t colon = assignment.find(':');
+        if (colon != string::npos) assignment[colon] = '=';
+        return assignment;
+    }
+
+    void serve(shared_ptr<DaemonConnection> client) {
+        thread writer(&DaemonConnection::write_lines, client.get());
+        string buffer, line;
+        while (client->read_line(buffer, line)) {
+            if (line.empty()) continue;
+            client->take_slot();
+            DaemonJob job;
+            string error;
+            if (!parse_job(line, job, error)) {
+                client->send_line("ERROR " + error);
+                continue;
+            }
+            job.client = client;
+            unique_lock<mutex> guard(queueLock);
+            spaceAvailable.wait(guard, [this]() { return queue.size() < queueCapacity; });
+            queue.push_back(move(job));
+            guard.unlock();
+            jobsAvailable.notify_one();
+        }
+        client->finish();
+        writer.join();
+    }
+
+public:
+    Daemon(const string &path, long long steps, int timeoutMs, size_t capacity)
+        : socketPath(path), defaultSteps(steps), defaultTimeoutMs(timeoutMs), queueCapacity(capacity) {}
+
+    int run(int workers) {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (listener < 0 || socketPath.size() >= sizeof(address.sun_path)) {
+            cout << "Error: Unable to create socket " << socketPath << endl;
+            return 1;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+        if (!remove_stale_socket(socketPath) || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 64) < 0) {
+            cout << "Error: Unable to listen on " << socketPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+
+        for (int i = 0; i < workers; ++i) thread(&Daemon::work, this).detach();
+        cout << "Listening on " << socketPath << " with " << workers << " workers" << endl;
+        while (true) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            thread(&Daemon::serve, this, make_shared<DaemonConnection>(client)).detach();
+        }
+    }
+};
+
+int run_daemon(int argc, char *argv[]) {
+    string socketPath = argc > 2 ? argv[2] : "";
+    int workers = max(1u, thread::hardware_concurrency());
+    size_t capacity = 1024;
+    long long steps = 1000000;
+    int timeoutMs = 1000;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--workers" && atoi(value.c_str()) > 0) {
+            workers = atoi(value.c_str());
+        } else if (option == "--queue" && atoi(value.c_str()) > 0) {
+            capacity = atoi(value.c_str());
+        } else if (option == "--steps" && atoll(value.c_str()) > 0) {
+            steps = atoll(value.c_str());
+        } else if (option == "--timeout" && atoi(value.c_str()) > 0) {
+            timeoutMs = atoi(value.c_str());
+        } else {
+            socketPath.clear();
+            break;
+        }
+        ++i;
+    }
+    if (socketPath.empty() || socketPath[0] == '-') {
+        cout << "Usage: " << argv[0] << " --daemon <socket path> [--workers <count>] [--queue <jobs>]\n"
+             << "       [--steps <default limit>] [--timeout <default ms>]\n";
+        return 1;
+    }
+    Daemon daemon(socketPath, steps, timeoutMs, capacity);
+    return daemon.run(workers);
+}
+
+// GDB remote serial protocol stub for one Machine. The register file is R0-RF followed by the
+// program counter, one byte each, and reads xx for the program counter once the machine has
+// halted. Between stops the machine runs at full speed, testing only its breakpoints.
+class GdbStub {
+private:
+    Machine &machine;
+    int fd = -1;
+    string buffer; // Received bytes not yet parsed
+    bool acknowledge = true;
+    bitset<256> breakpoints;
+
+    void send_raw(const string &data) {
+        for (size_t sent = 0; sent < data.size();) {
+            ssize_t written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) return;
+            sent += written;
+        }
+    }
+
+    void send_packet(const string &payload) {
+        uint8_t checksum = 0;
+        for (char c : payload) checksum += c;
+        stringstream packet;
+        packet << "$" << payload << "#" << nouppercase << hex << setw(2) << setfill('0') << int(checksum);
+        send_raw(packet.str());
+    }
+
+    // Waits for the next packet and acknowledges it; false once the debugger has disconnected.
+    // Acknowledgements and interrupts arriving between packets are skipped.
+    bool read_packet(string &payload) {
+        while (true) {
+            size_t start = buffer.find('$');
+            size_t end = start == string::npos ? string::npos : buffer.find('#', start);
+            if (end != string::npos && end + 2 < buffer.size()) {
+                uint8_t checksum = 0;
+                for (size_t i = start + 1; i < end; ++i) checksum += buffer[i];
+                payload.clear();
+                for (size_t i = start + 1; i < end; ++i) {
+                    payload += buffer[i] == '}' && i + 1 < end ? buffer[++i] ^ 0x20 : buffer[i]; // Escaped byte
+                }
+                bool valid = parse_hex_byte(buffer, end + 1) == checksum;
+                buffer.erase(0, end + 3);
+                if (acknowledge) send_raw(valid ? "+" : "-");
+                if (valid) return true;
+                continue;
+            }
+            char chunk[4096];
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) return false;
+            buffer.append(chunk, received);
+        }
+    }
+
+    // Whether the debugger has sent an interrupt (0x03) while the machine was running
+    bool interrupted() {
+        char chunk[4096];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received <= 0) return false;
+        buffer.append(chunk, received);
+        size_t interrupt = buffer.find('\x03');
+        if (interrupt == string::npos) return false;
+        buffer.erase(interrupt, 1);
+        return true;
+    }
+
+    // Stop reply for the machine's current state
+    string stop_reply(int signal) const {
+        if (machine.halted()) return "W00";
+        stringstream reply;
+        reply << "S" << hex_byte(signal);
+        return reply.str();
+    }
+
+    // Steps once, or runs until a breakpoint, HALT, an invalid instruction or an interrupt. A
+    // breakpoint at the starting address does not stop the machine before it has moved.
+    string resume(bool single) {
+        for (long long executed = 1;; ++executed) {
+            if (!machine.step(nullptr)) return machine.halted() ? "W00" : "S04"; // SIGILL
+            if (machine.halted()) return "W00";
+            if (single || breakpoints[machine.program_counter() & 0xFF]) return "S05"; // SIGTRAP
+            if ((executed & 0xFFFF) == 0 && interrupted()) return "S02";           // SIGINT
+        }
+    }
+
+    // Parses "addr,len" into address and length; false unless the range lies inside memory
+    static bool parse_range(const string &text, int &address, int &length) {
+        size_t comma = text.find(',');
+        if (comma == string::npos) return false;
+        address = parse_hex(text.substr(0, comma));
+        length = parse_hex(text.substr(comma + 1));
+        return address >= 0 && length >= 0 && address + length <= 256;
+    }
+
+    string register_hex(int index) const {
+        if (index < 16) {
+            stringstream value;
+            value << hex_byte(machine.register_value(index));
+            return value.str();
+        }
+        if (machine.halted()) return "xx";
+        stringstream value;
+        value << hex_byte(machine.program_counter());
+        return value.str();
+    }
+
+    // Two hex digits, or xx for a register to leave alone
+    static bool register_text(const string &text) {
+        return text.size() == 2 && (text == "xx" || parse_hex_byte(text) >= 0);
+    }
+
+    // Sets a register from text, which register_text has accepted
+    void set_register(int index, const string &text) {
+        int value = parse_hex_byte(text);
+        if (value < 0) return; // xx leaves the register alone
+        if (index < 16) machine.set_register(index, value);
+        else machine.jump_to(value);
+    }
+
+    // Handles one packet and returns its reply, if it has one. done is set when the session ends.
+    optional<string> handle(const string &packet, bool &done) {
+        char command = packet.empty() ? 0 : packet[0];
+        string arguments = packet.empty() ? "" : packet.substr(1);
+        switch (command) {
+            case '?': return stop_reply(5);
+            case 'g': {
+                string registers;
+                for (int i = 0; i <= 16; ++i) registers += register_hex(i);
+                return registers;
+            }
+            case 'G':
+                if (arguments.size() != 34) return "E01";
+                for (int i = 0; i <= 16; ++i) {
+                    if (!register_text(arguments.substr(2 * i, 2))) return "E01";
+                }
+                for (int i = 0; i <= 16; ++i) set_register(i, arguments.substr(2 * i, 2));
+                return "OK";
+            case 'p': {
+                int index = parse_hex(arguments);
+                return index >= 0 && index <= 16 ? register_hex(index) : "E01";
+            }
+            case 'P': {
+                size_t equals = arguments.find('=');
+                int index = parse_hex(arguments.substr(0, equals));
+                if (equals == string::npos || index < 0 || index > 16 || !register_text(arguments.substr(equals + 1))) {
+                    return "E01";
+                }
+                set_register(index, arguments.substr(equals + 1));
+                return "OK";
+            }
+            case 'm': {
+                int address, length;
+                if (!parse_range(arguments, address, length)) return "E01";
+                stringstream bytes;
+                for (int i = 0; i < length; ++i) bytes << hex_byte(machine.cell_value(address + i));
+                return bytes.str();
+            }
+            case 'M': {
+                size_t colon = arguments.find(':');
+                int address, length;
+                if (colon == string::npos || !parse_range(arguments.substr(0, colon), address, length)
+                    || arguments.size() - colon - 1 != static_cast<size_t>(2 * length)) {
+                    return "E01";
+                }
+                for (int i = 0; i < length; ++i) {
+                    if (parse_hex_byte(arguments, colon + 1 + 2 * i) < 0) return "E01"; // Nothing is written
+                }
+                for (int i = 0; i < length; ++i) machine.set_cell(address + i, parse_hex_byte(arguments, colon + 1 + 2 * i));
+                return "OK";
+            }
+            case 'Z':
+            case 'z': {
+                // Z0 and Z1 (software and hardware breakpoints) are the same thing here
+                int address = arguments.size() > 2 ? parse_hex(arguments.substr(2, arguments.find(',', 2) - 2)) : -1;
+                if ((arguments[0] != '0' && arguments[0] != '1') || arguments[1] != ',' || address < 0 || address > 0xFF) {
+                    return "";
+                }
+                breakpoints[address] = command == 'Z';
+                return "OK";
+            }
+            case 's':
+            case 'c':
+                if (!arguments.empty()) {
+                    int address = parse_hex(arguments);
+                    if (address < 0 || address > 0xFF) return "E01";
+                    machine.jump_to(address);
+                }
+                return resume(command == 's');
+            case 'v':
+                if (packet == "vCont?") return "vCont;c;s";
+                if (packet.compare(0, 7, "vCont;c") == 0) return resume(false);
+                if (packet.compare(0, 7, "vCont;s") == 0) return resume(true);
+                return "";
+            case 'q':
+                if (packet.compare(0, 10, "qSupported") == 0) return "PacketSize=4000;QStartNoAckMode+";
+                if (packet == "qAttached") return "1";
+                if (packet == "qC") return "QC1";
+                if (packet == "qfThreadInfo") return "m1";
+                if (packet == "qsThreadInfo") return "l";
+                return "";
+            case 'Q':
+                return packet == "QStartNoAckMode" ? "OK" : ""; // Acknowledgements stop after the reply
+            case 'H':
+            case 'T':
+                return "OK";
+            case 'D':
+                done = true;
+                return "OK";
+            case 'k':
+                done = true;
+                return nullopt; // Kill has no reply
+            default:
+                return "";
+        }
+    }
+
+public:
+    explicit GdbStub(Machine &target) : machine(target) {}
+
+    // Serves debugger sessions on listener one after another; the machine keeps its state
+    // between sessions. Returns when a debugger kills the machine.
+    void serve(int listener) {
+        while (true) {
+            fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+            buffer.clear();
+            acknowledge = true;
+            bool done = false, killed = false;
+            string packet;
+            while (!done && read_packet(packet)) {
+                optional<string> reply = handle(packet, done);
+                if (reply) send_packet(*reply);
+                if (packet == "QStartNoAckMode") acknowledge = false;
+                killed = packet == "k";
+            }
+            close(fd);
+            if (killed) return;
+        }
+    }
+};
+
+// Listens on a loopback TCP port, or on a Unix socket path when target is not a number
+int listen_on(const string &target) {
+    bool tcp = !target.empty() && target.find_first_not_of("0123456789") == string::npos;
+    int listener = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return -1;
+    if (tcp) {
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(atoi(target.c_str()));
+        if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) return -1;
+    } else {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (target.size() >= sizeof(address.sun_path)) return -1;
+        strcpy(address.sun_path, target.c_str());
+        if (!remove_stale_socket(target) || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) return -1;
+    }
+    return listen(listener, 1) < 0 ? -1 : listener;
+}
+
+int run_gdb(int argc, char *argv[]) {
+    int startAddress = 0;
+    bool valid = argc >= 4;
+    for (int i = 4; i < argc && valid; i += 2) {
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        valid = string(argv[i]) == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF;
+        if (valid) startAddress = parse_hex(value);
+    }
+    ifstream file(valid ? argv[2] : "");
+    if (!file.is_open()) {
+        cout << "Usage: " << argv[0] << " --gdb <program file> <port or socket path> [--start <address>]\n";
+        return 1;
+    }
+
+    Machine machine;
+    machine.load_words(file, startAddress);
+    int listener = listen_on(argv[3]);
+    if (listener < 0) {
+        cout << "Error: Unable to listen on " << argv[3] << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    cout << "Waiting for a debugger on " << argv[3] << endl;
+    GdbStub(machine).serve(listener);
+    close(listener);
+    return 0;
+}
+
+// Single-pass assembler for the syntax disassemble() prints, plus labels and data:
+//
+//   start:  LOADI R1, 0x05      ; comments run to the end of the line
+//           LOAD R2, [value]    ; labels work anywhere a byte value does
+//   loop:   ADD R3, R3, R2
+//           JMPEQ R3, done      ; used before it is defined: patched when done: appears
+//           JMP loop            ; shorthand for JMPEQ R0, loop
+//   done:   HALT
+//           .org 0x40           ; continue at address 40
+//   value:  .byte 0x03, 7, -1
+//
+// Numbers are 0x-prefixed hex or decimal. The result is a Program holding the memory image and
+// every instruction already decoded, so a Machine starts on it by copying.
+class Assembler {
+private:
+    struct Fixup {
+        int address; // Byte to patch
+        int line;
+        int maximum; // Largest value the byte may take
+    };
+
+    array<uint8_t, 256> image{};
+    bitset<256> instructionStarts;
+    unordered_map<string, int> labels;
+    unordered_map<string, vector<Fixup>> pending; // Uses of labels not defined yet
+    int address = 0;
+    int startAddress = -1;     // First instruction assembled
+    int lineNumber = 0;
+    bool extensions;
+    vector<string> errors;
+
+    void error(const string &message) { errors.push_back("line " + to_string(lineNumber) + ": " + message); }
+
+    static string_view trim(string_view text) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == string_view::npos) return {};
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    // Splits operands at commas, trimmed
+    static vector<string_view> split_operands(string_view text) {
+        vector<string_view> operands;
+        while (!text.empty()) {
+            size_t comma = text.find(',');
+            operands.push_back(trim(text.substr(0, comma)));
+            if (comma == string_view::npos) break;
+            text.remove_prefix(comma + 1);
+        }
+        return operands;
+    }
+
+    // Rn with n from 0 to F; -1 if operand is not a register
+    static int parse_register(string_view operand) {
+        if (operand.size() != 2 || (operand[0] != 'R' && operand[0] != 'r')) return -1;
+        return hex_digit(operand[1]);
+    }
+
+    // A byte operand for the byte at target: a number from -128 to 255 or a label. Labels not yet
+    // defined are left as 0 and patched later, when their address is checked against maximum.
+    // Returns false after reporting a bad operand.
+    bool byte_value(string_view operand, int target, int &value, int maximum = 0xFF) {
+        bool negative = !operand.empty() && operand[0] == '-';
+        string_view digits = negative ? operand.substr(1) : operand;
+        bool hexadecimal = digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X');
+        if (hexadecimal) digits.remove_prefix(2);
+        if (!digits.empty() && (isdigit(static_cast<unsigned char>(digits[0])) || hexadecimal)) {
+            long number = 0;
+            for (char c : digits) {
+                int digit = hexadecimal ? hex_digit(c) : (isdigit(static_cast<unsigned char>(c)) ? c - '0' : -1);
+                if (digit < 0 || number > 0xFFFF) {
+                    error("Bad number '" + string(operand) + "'");
+                    return false;
+                }
+                number = number * (hexadecimal ? 16 : 10) + digit;
+            }
+            if (negative) number = -number;
+            if (number < -128 || number > 255) {
+                error("'" + string(operand) + "' does not fit in a byte");
+                return false;
+            }
+            value = number & 0xFF;
+            return true;
+        }
+        if (operand.empty() || negative || !(isalpha(static_cast<unsigned char>(operand[0])) || operand[0] == '_')) {
+            error("Expected a number or label, found '" + string(operand) + "'");
+            return false;
+        }
+        auto label = labels.find(string(operand));
+        if (label != labels.end()) {
+            if (label->second > maximum) {
+                error("Label '" + label->first + "' (" + to_string(label->second) + ") is larger than " + to_string(maximum));
+                return false;
+            }
+            value = label->second;
+        } else {
+            pending[string(operand)].push_back({target, lineNumber, maximum});
+            value = 0;
+        }
+        return true;
+    }
+
+    void define_label(string_view name) {
+        string label(name);
+        if (!labels.emplace(label, address).second) {
+            error("Label '" + label + "' is already defined");
+            return;
+        }
+        auto uses = pending.find(label);
+        if (uses == pending.end()) return;
+        for (const Fixup &fixup : uses->second) {
+            if (address > fixup.maximum) {
+                errors.push_back("line " + to_string(fixup.line) + ": Label '" + label + "' (" + to_string(address)
+                                 + ") is larger than " + to_string(fixup.maximum));
+            }
+            image[fixup.address] = address;
+        }
+        pending.erase(uses);
+    }
+
+    // Writes a byte of output; an instruction it lands in is no longer one
+    void emit(int at, int value) {
+        image[at] = value;
+        instructionStarts[at] = false;
+        if (at > 0) instructionStarts[at - 1] = false;
+    }
+
+    bool reserve(int bytes) {
+        if (address + bytes > 256) {
+            error("Program does not fit in memory");
+            return false;
+        }
+        return true;
+    }
+
+    void directive(string_view name, string_view operandText) {
+        vector<string_view> operands = split_operands(operandText);
+        int value = 0;
+        if (name == ".org") {
+            if (operands.size() != 1 || !byte_value(operands[0], 0, value)) {
+                if (operands.size() != 1) error(".org takes one address");
+                return;
+            }
+            if (pending.count(string(operands[0]))) error(".org needs an address known at this point");
+            address = value;
+        } else if (name == ".byte") {
+            if (operands.empty()) error(".byte needs at least one value");
+            for (string_view operand : operands) {
+                if (!reserve(1)) return;
+                if (byte_value(operand, address, value)) emit(address, value);
+                ++address;
+            }
+        } else {
+            error("Unknown directive '" + string(name) + "'");
+        }
+    }
+
+    void instruction(string_view mnemonic, string_view operandText) {
+        string name(mnemonic);
+        for (char &c : name) c = toupper(static_cast<unsigned char>(c));
+        bool jump = name == "JMP";
+        if (jump) name = "JMPEQ";
+        // First decode table row for each mnemonic, i.e. with register 0
+        static const unordered_map<string, const DecodeEntry *> mnemonics = []() {
+            unordered_map<string, const DecodeEntry *> rows;
+            for (const DecodeEntry &row : decodeTable) {
+                if (row.opcode != Opcode::Invalid) rows.emplace(row.mnemonic, &row);
+            }
+            return rows;
+        }();
+        auto found = mnemonics.find(name);
+        if (found == mnemonics.end()) {
+            error("Unknown instruction '" + string(mnemonic) + "'");
+            return;
+        }
+        const DecodeEntry *entry = found->second;
+        if (entry->extension && !extensions) {
+            error(name + " is an extension opcode; enable extensions to use it");
+            return;
+        }
+        if (!reserve(2)) return;
+
+        vector<string_view> operands = split_operands(operandText);
+        size_t reported = errors.size();
+        int nibble = (entry - decodeTable.data()) >> 4;
+        int r = 0, s = 0, t = 0, second = 0;
+        bool valid;
+        switch (entry->opcode) {
+            case Opcode::LoadFromMemory:
+            case Opcode::StoreToMemory:
+            case Opcode::CompareAndSwap: {
+                // R, [address]
+                string_view cell = operands.size() == 2 ? operands[1] : "";
+                valid = cell.size() > 2 && cell.front() == '[' && cell.back() == ']' && (r = parse_register(operands[0])) >= 0;
+                valid = valid && byte_value(trim(cell.substr(1, cell.size() - 2)), address + 1, second);
+                break;
+            }
+            case Opcode::LoadImmediate:
+            case Opcode::JumpIfEqual:
+            case Opcode::JumpIfGreater:
+                if (jump) {
+                    valid = operands.size() == 1 && byte_value(operands[0], address + 1, second);
+                } else {
+                    valid = operands.size() == 2 && (r = parse_register(operands[0])) >= 0
+                            && byte_value(operands[1], address + 1, second);
+                }
+                break;
+            case Opcode::Move:
+                // MOVE destination, source encodes as 40RS with R the source
+                valid = operands.size() == 2 && (t = parse_register(operands[0])) >= 0 && (s = parse_register(operands[1])) >= 0;
+                second = (s << 4) | t;
+                break;
+            case Opcode::Add:
+            case Opcode::AddFloat:
+            case Opcode::Or:
+            case Opcode::And:
+            case Opcode::Xor:
+                valid = operands.size() == 3 && (r = parse_register(operands[0])) >= 0
+                        && (s = parse_register(operands[1])) >= 0 && (t = parse_register(operands[2])) >= 0;
+                second = (s << 4) | t;
+                break;
+            case Opcode::Rotate:
+                valid = operands.size() == 2 && (r = parse_register(operands[0])) >= 0
+                        && byte_value(operands[1], address + 1, second, 15) && second < 16;
+                break;
+            default: // HALT
+                valid = operands.empty();
+                break;
+        }
+        if (!valid) {
+            if (errors.size() == reported) error("Bad operands for " + name + ": '" + string(operandText) + "'");
+            return;
+        }
+
+        // Labels patched later only ever replace the second byte
+        emit(address, (nibble << 4) | r);
+        emit(address + 1, second);
+        instructionStarts[address] = true;
+        if (startAddress < 0) startAddress = address;
+        address += 2;
+    }
+
+public:
+    explicit Assembler(bool allowExtensions = false) : extensions(allowExtensions) {}
+
+    // Assembles source. Returns the program, or nullptr with the problems in problems.
+    shared_ptr<Program> assemble(string_view source, vector<string> &problems) {
+        while (!source.empty()) {
+            ++lineNumber;
+            size_t newline = source.find('\n');
+            string_view line = source.substr(0, newline);
+            source.remove_prefix(newline == string_view::npos ? source.size() : newline + 1);
+
+            line = trim(line.substr(0, line.find(';')));
+            size_t colon = line.find(':');
+            if (colon != string_view::npos) {
+                string_view label = trim(line.substr(0, colon));
+                if (label.empty() || label.find_first_of(" \t,[") != string_view::npos) {
+                    error("Bad label '" + string(label) + "'");
+                } else {
+                    define_label(label);
+                }
+                line = trim(line.substr(colon + 1));
+            }
+            if (line.empty()) continue;
+
+            size_t space = line.find_first_of(" \t");
+            string_view word = line.substr(0, space);
+            string_view operands = space == string_view::npos ? "" : trim(line.substr(space));
+            if (word[0] == '.') directive(word, operands);
+            else instruction(word, operands);
+        }
+        for (const auto &use : pending) {
+            for (const Fixup &fixup : use.second) {
+                errors.push_back("line " + to_string(fixup.line) + ": Undefined label '" + use.first + "'");
+            }
+        }
+        problems = errors;
+        if (!errors.empty()) return nullptr;
+
+        auto program = make_shared<Program>();
+        program->startAddress = max(startAddress, 0);
+        for (int i = 0; i < 256; ++i) program->image.write(i, image[i]);
+        // Bytes written over an instruction may no longer decode, or decode to an extension opcode
+        for (int i = 0; i < 255; ++i) {
+            const DecodeEntry &entry = decodeTable[image[i]];
+            if (instructionStarts[i] && entry.opcode != Opcode::Invalid && !(entry.extension && !extensions)) {
+                program->decoded[i].decode(entry, image[i], image[i + 1]);
+            }
+        }
+        return program;
+    }
+};
+
+// Assembles a source file and prints its listing, or runs it, or writes its 256-byte memory image
+int run_assemble(int argc, char *argv[]) {
+    string imageFile;
+    bool run = false, extensions = false;
+    long long maxSteps = 1000000;
+    bool valid = argc >= 3;
+    for (int i = 3; i < argc && valid; ++i) {
+        string option = argv[i];
+        if (option == "--run") run = true;
+        else if (option == "--extensions") extensions = true;
+        else if (option == "--image" && i + 1 < argc) imageFile = argv[++i];
+        else if (option == "--steps" && i + 1 < argc && atoll(argv[i + 1]) > 0) maxSteps = atoll(argv[++i]);
+        else valid = false;
+    }
+    ifstream file(valid ? argv[2] : "");
+    if (!file.is_open()) {
+        cout << "Usage: " << argv[0] << " --asm <source file> [--run] [--steps <limit>] [--image <file>] [--extensions]\n";
+        return 1;
+    }
+    stringstream source;
+    source << file.rdbuf();
+
+    vector<string> problems;
+    shared_ptr<const Program> program = Assembler(extensions).assemble(source.str(), problems);
+    for (const string &problem : problems) cout << "Error: " << argv[2] << ", " << problem << "\n";
+    if (!program) return 1;
+
+    Machine machine(program);
+    if (extensions) machine.enable_extensions();
+    if (!imageFile.empty()) {
+        ofstream out(imageFile, ios::binary);
+        for (int i = 0; i < 256; ++i) out.put(static_cast<char>(machine.cell_value(i)));
+        if (!out) {
+            cout << "Error: Unable to write " << imageFile << endl;
+            return 1;
+        }
+    }
+    if (run) {
+        long long steps = machine.run_silent(maxSteps);
+        cout << "Stopped (" << machine.stop_reason(steps, maxSteps) << ") after " << steps << " instructions\n";
+        machine.display_status();
+    } else if (imageFile.empty()) {
+        for (int i = 0; i < 255; ++i) {
+            int first = machine.cell_value(i), second = machine.cell_value(i + 1);
+            if (program->decoded[i].get(first, second)) {
+                cout << hex_byte(i) << ": " << hex_byte(first) << hex_byte(second) << "  " << disassemble(first, second) << "\n";
+            }
+        }
+    }
+    return 0;
+}
+
+// A byte during path exploration: a constant, or a function of one or two marked input cells
+// given as the byte it takes for each combination of their values
+struct SymbolicByte {
+    array<int, 2> inputs{-1, -1}; // Indices of the marked inputs it depends on, ascending; -1 if unused
+    uint8_t value = 0;
+    bool tainted = false;         // A constant computed from inputs, so it still decides the path
+    shared_ptr<const vector<uint8_t>> table; // By the first input's value, times 256 plus the second's
+
+    bool symbolic() const { return inputs[0] >= 0; }
+    bool depends_on_inputs() const { return symbolic() || tainted; }
+
+    uint8_t at(const vector<int> &values) const {
+        if (!symbolic()) return value;
+        int index = values[inputs[0]];
+        if (inputs[1] >= 0) index = index * 256 + values[inputs[1]];
+        return (*table)[index];
+    }
+};
+
+// Marked inputs whose values on a path are constrained together: one input, or two that an
+// operation combined. allowed holds the combinations for which execution follows the path,
+// indexed like SymbolicByte::table.
+struct InputFactor {
+    array<int, 2> inputs{-1, -1};
+    vector<bool> allowed;
+
+    // The value input takes in the combination tuple
+    int value(int tuple, int input) const { return inputs[1] < 0 ? tuple : input == inputs[0] ? tuple >> 8 : tuple & 0xFF; }
+};
+
+// One path being explored. Memory is held in 16-byte chunks shared between forks and copied on
+// the first write by a path that does not own its chunk alone. factors hold the input values for
+// which execution follows this path; factorOf gives each marked input's factor. trace records
+// every decision that depended on an input: the words fetched and the jumps taken or not.
+struct ExplorerState {
+    using Chunk = array<SymbolicByte, 16>;
+
+    array<SymbolicByte, 16> registers;
+    array<shared_ptr<Chunk>, 16> chunks;
+    vector<InputFactor> factors;
+    vector<int> factorOf;
+    int programCounter = 0;
+    long long steps = 0;
+    string trace;
+
+    const SymbolicByte &cell(int address) const { return (*chunks[address >> 4])[address & 0xF]; }
+
+    void set_cell(int address, const SymbolicByte &value) {
+        shared_ptr<Chunk> &chunk = chunks[address >> 4];
+        // Only this state can copy a chunk it holds the sole reference to, so the count is exact
+        if (chunk.use_count() > 1) chunk = make_shared<Chunk>(*chunk);
+        (*chunk)[address & 0xF] = value;
+    }
+
+    InputFactor &factor(const SymbolicByte &value) { return factors[factorOf[value.inputs[0]]]; }
+    const InputFactor &factor(const SymbolicByte &value) const { return factors[factorOf[value.inputs[0]]]; }
+
+    // The byte a symbolic value takes in the combination tuple of its factor
+    uint8_t at(const SymbolicByte &value, int tuple) const {
+        const InputFactor &inputs = factor(value);
+        int index = inputs.value(tuple, value.inputs[0]);
+        if (value.inputs[1] >= 0) index = index * 256 + inputs.value(tuple, value.inputs[1]);
+        return (*value.table)[index];
+    }
+
+    // Sets constant if value is the same byte for every input combination this path allows
+    bool constant(const SymbolicByte &value, uint8_t &constant) const {
+        if (!value.symbolic()) {
+            constant = value.value;
+            return true;
+        }
+        const vector<bool> &allowed = factor(value).allowed;
+        int first = -1;
+        for (size_t tuple = 0; tuple < allowed.size(); ++tuple) {
+            if (!allowed[tuple]) continue;
+            if (first < 0) first = tuple;
+            else if (at(value, tuple) != at(value, first)) return false;
+        }
+        constant = at(value, first);
+        return true;
+    }
+
+    // Joins the factors of two single inputs a and b into one over both
+    void merge(int a, int b) {
+        if (a > b) swap(a, b);
+        InputFactor &first = factors[factorOf[a]];
+        InputFactor &second = factors[factorOf[b]];
+        vector<bool> allowed(65536);
+        for (int x = 0; x < 256; ++x) {
+            for (int y = 0; first.allowed[x] && y < 256; ++y) allowed[x * 256 + y] = second.allowed[y];
+        }
+        first.inputs = {a, b};
+        first.allowed = move(allowed);
+        second = InputFactor();
+        factorOf[b] = factorOf[a];
+    }
+
+    // Smallest allowed combination of each factor: the concrete inputs that drive execution down
+    // this path
+    vector<int> concrete_inputs() const {
+        vector<int> values(factorOf.size());
+        for (const InputFactor &inputs : factors) {
+            if (inputs.inputs[0] < 0) continue;
+            int tuple = 0;
+            while (tuple + 1 < static_cast<int>(inputs.allowed.size()) && !inputs.allowed[tuple]) ++tuple;
+            for (int input : inputs.inputs) {
+                if (input >= 0) values[input] = inputs.value(tuple, input);
+            }
+        }
+        return values;
+    }
+
+    // Everything that decides where execution goes from here: the program counter, every byte
+    // over the input combinations it can still take, and the factors still referenced. Two states
+    // with the same key have the same future.
+    string key() const {
+        string text(1, static_cast<char>(programCounter));
+        vector<bool> referenced(factors.size());
+        auto add = [&](const SymbolicByte &value) {
+            text += static_cast<char>(value.inputs[0]);
+            text += static_cast<char>(value.inputs[1]);
+            if (!value.symbolic()) {
+                text += static_cast<char>(value.value);
+                text += static_cast<char>(value.tainted);
+                return;
+            }
+            referenced[factorOf[value.inputs[0]]] = true;
+            const vector<bool> &allowed = factor(value).allowed;
+            for (size_t tuple = 0; tuple < allowed.size(); ++tuple) {
+                if (allowed[tuple]) text += static_cast<char>(at(value, tuple));
+            }
+        };
+        for (const SymbolicByte &value : registers) add(value);
+        for (int address = 0; address < 256; ++address) add(cell(address));
+        for (size_t i = 0; i < factors.size(); ++i) {
+            if (!referenced[i]) continue;
+            const vector<bool> &allowed = factors[i].allowed;
+            for (size_t tuple = 0; tuple < allowed.size(); tuple += 8) {
+                char bits = 0;
+                for (int bit = 0; bit < 8; ++bit) bits |= allowed[tuple + bit] << bit;
+                text += bits;
+            }
+        }
+        return text;
+    }
+};
+
+// Explores every path a program can take depending on the values of marked input cells. A
+// JMPEQ or JMPGT whose comparison depends on the inputs splits their allowed combinations into
+// those that jump and those that do not, and execution forks into both. Operations relate up to
+// two inputs exactly. A byte that depends on inputs where a single value is needed (an instruction
+// word, or an operation relating a third input) forks once per distinct value it can take. Forks
+// go through a work queue shared by worker threads, which drop any state they have already seen.
+// Paths that made the same input-dependent decisions are reported once, for their smallest inputs.
+class Explorer {
+public:
+    struct Path {
+        vector<int> inputs; // Concrete values of the marked cells that follow this path
+        string status;
+        long long steps;
+        int programCounter;
+        array<uint8_t, 16> registers;
+        array<uint8_t, 256> cells;
+    };
+
+private:
+    vector<int> inputCells;
+    long long maxSteps;
+    size_t maxPaths;
+    bool truncated = false;
+
+    mutex queueLock;
+    condition_variable workAvailable;
+    deque<ExplorerState> queue;
+    int active = 0;
+    size_t forks = 0;
+    unordered_set<string> seen;
+
+    mutex pathsLock;
+    vector<Path> paths;
+    unordered_map<string, size_t> pathByTrace;
+
+    // Moves the input combinations in subset of a factor out of state into a new path queued for
+    // the workers. Past the path limit they are dropped instead.
+    void fork(ExplorerState &state, int factor, const vector<bool> &subset) {
+        ExplorerState child = state;
+        child.factors[factor].allowed = subset;
+        vector<bool> &allowed = state.factors[factor].allowed;
+        for (size_t tuple = 0; tuple < allowed.size(); ++tuple) allowed[tuple] = allowed[tuple] && !subset[tuple];
+        string key = child.key();
+        lock_guard<mutex> guard(queueLock);
+        if (forks >= maxPaths) {
+            truncated = true;
+            return;
+        }
+        ++forks;
+        if (seen.insert(move(key)).second) {
+            queue.push_back(move(child));
+            workAvailable.notify_one();
+        }
+    }
+
+    // Records state as seen after it has forked. Returns false, with an empty status ending the
+    // path unreported, if an identical state is already being explored.
+    bool unseen(const ExplorerState &state, string &status) {
+        string key = state.key();
+        lock_guard<mutex> guard(queueLock);
+        if (seen.insert(move(key)).second) return true;
+        status.clear();
+        return false;
+    }
+
+    // The allowed combinations of value's factor grouped by the byte value takes on them
+    static map<uint8_t, vector<bool>> classes(const ExplorerState &state, const SymbolicByte &value) {
+        map<uint8_t, vector<bool>> groups;
+        const vector<bool> &allowed = state.factor(value).allowed;
+        for (size_t tuple = 0; tuple < allowed.size(); ++tuple) {
+            if (!allowed[tuple]) continue;
+            vector<bool> &group = groups[state.at(value, tuple)];
+            if (group.empty()) group.resize(allowed.size());
+            group[tuple] = true;
+        }
+        return groups;
+    }
+
+    // Forks state so that value is constant on each path: one path per distinct byte
+    void split(ExplorerState &state, const SymbolicByte &value) {
+        map<uint8_t, vector<bool>> groups = classes(state, value);
+        int factor = state.factorOf[value.inputs[0]];
+        for (auto it = next(groups.begin()); it != groups.end(); ++it) fork(state, factor, it->second);
+    }
+
+    // Combines a and b byte by byte. Returns false after splitting state when together they
+    // depend on inputs from factors that cannot be joined; the instruction then runs again on
+    // each path.
+    template <typename Operation>
+    bool combine(ExplorerState &state, const SymbolicByte &a, const SymbolicByte &b, SymbolicByte &result, Operation operation) {
+        uint8_t ca, cb;
+        bool aConstant = state.constant(a, ca), bConstant = state.constant(b, cb);
+        if (aConstant && bConstant) {
+            result = SymbolicByte{{-1, -1}, static_cast<uint8_t>(operation(ca, cb)), a.depends_on_inputs() || b.depends_on_inputs(), nullptr};
+            return true;
+        }
+        const SymbolicByte &symbolic = aConstant ? b : a;
+        array<int, 2> inputs = symbolic.inputs;
+        if (!aConstant && !bConstant && state.factorOf[a.inputs[0]] != state.factorOf[b.inputs[0]]) {
+            // Two factors: join them if that relates only two inputs, otherwise make the operand
+            // with fewer values constant
+            if (a.inputs[1] >= 0 || b.inputs[1] >= 0 || state.factor(a).inputs[1] >= 0 || state.factor(b).inputs[1] >= 0) {
+                split(state, classes(state, a).size() <= classes(state, b).size() ? a : b);
+                return false;
+            }
+            state.merge(a.inputs[0], b.inputs[0]);
+            inputs = {min(a.inputs[0], b.inputs[0]), max(a.inputs[0], b.inputs[0])};
+        } else if (!aConstant && !bConstant && a.inputs != b.inputs) {
+            inputs = state.factor(a).inputs; // One factor over two inputs, used partly by each
+        }
+
+        // Each operand at one combination of the result's inputs
+        auto operand = [](const SymbolicByte &value, bool isConstant, uint8_t constant, const array<int, 2> &over, int x, int y) {
+            if (isConstant) return constant;
+            int index = value.inputs[0] == over[0] ? x : y;
+            if (value.inputs[1] >= 0) index = index * 256 + y;
+            return (*value.table)[index];
+        };
+        int size = inputs[1] >= 0 ? 65536 : 256;
+        auto table = make_shared<vector<uint8_t>>(size);
+        for (int index = 0; index < size; ++index) {
+            int x = inputs[1] >= 0 ? index >> 8 : index, y = index & 0xFF;
+            (*table)[index] = operation(operand(a, aConstant, ca, inputs, x, y), operand(b, bConstant, cb, inputs, x, y));
+        }
+        result = SymbolicByte{inputs, 0, false, move(table)};
+        return true;
+    }
+
+    // Executes one instruction. Returns false with the reason in status when the path ends.
+    bool step(ExplorerState &state, string &status) {
+        if (state.programCounter < 0 || state.programCounter + 1 >= 256) {
+            status = state.programCounter < 0 ? "halted" : "invalid";
+            return false;
+        }
+        if (state.steps >= maxSteps) {
+            status = "limit";
+            return false;
+        }
+        uint8_t first, second;
+        for (int address : {state.programCounter, state.programCounter + 1}) {
+            if (!state.constant(state.cell(address), address == state.programCounter ? first : second)) {
+                split(state, state.cell(address));
+                return unseen(state, status); // Fetch again on a path where the word is known
+            }
+        }
+        if (state.cell(state.programCounter).depends_on_inputs() || state.cell(state.programCounter + 1).depends_on_inputs()) {
+            state.trace += {'F', static_cast<char>(state.programCounter), static_cast<char>(first), static_cast<char>(second)};
+        }
+        const DecodeEntry &entry = decodeTable[first];
+        if (entry.opcode == Opcode::Invalid || entry.extension) {
+            status = "invalid";
+            return false;
+        }
+
+        SymbolicByte &r = state.registers[entry.reg];
+        const SymbolicByte &s = state.registers[second >> 4], &t = state.registers[second & 0xF];
+        SymbolicByte result;
+        bool done = true;
+        int next = state.programCounter + 2;
+        switch (entry.opcode) {
+            case Opcode::LoadFromMemory: result = state.cell(second); break;
+            case Opcode::LoadImmediate: result = SymbolicByte{{-1, -1}, second, false, nullptr}; break;
+            case Opcode::StoreToMemory: state.set_cell(second, r); break;
+            case Opcode::Move: result = s; break;
+            case Opcode::Add: done = combine(state, s, t, result, [](uint8_t a, uint8_t b) { return a + b; }); break;
+            case Opcode::AddFloat: done = combine(state, s, t, result, float_add); break;
+            case Opcode::Or: done = combine(state, s, t, result, [](uint8_t a, uint8_t b) { return a | b; }); break;
+            case Opcode::And: done = combine(state, s, t, result, [](uint8_t a, uint8_t b) { return a & b; }); break;
+            case Opcode::Xor: done = combine(state, s, t, result, [](uint8_t a, uint8_t b) { return a ^ b; }); break;
+            case Opcode::Rotate: {
+                int count = (second & 0xF) % 8;
+                done = combine(state, r, r, result, [count](uint8_t a, uint8_t) { return (a >> count) | (a << (8 - count)); });
+                break;
+            }
+            case Opcode::JumpIfEqual:
+            case Opcode::JumpIfGreater: {
+                bool equal = entry.opcode == Opcode::JumpIfEqual;
+                done = combine(state, r, state.registers[0], result, [equal](uint8_t a, uint8_t b) {
+                    return equal ? a == b : static_cast<int8_t>(a) > static_cast<int8_t>(b);
+                });
+                uint8_t jump;
+                if (done && !state.constant(result, jump)) {
+                    const vector<bool> &allowed = state.factor(result).allowed;
+                    vector<bool> taken(allowed.size());
+                    for (size_t tuple = 0; tuple < allowed.size(); ++tuple) taken[tuple] = allowed[tuple] && state.at(result, tuple);
+                    fork(state, state.factorOf[result.inputs[0]], taken);
+                    return unseen(state, status); // The comparison is now decided on this path; run it again
+                }
+                if (done && result.depends_on_inputs()) {
+                    state.trace += {'J', static_cast<char>(state.programCounter), static_cast<char>(jump)};
+                }
+                if (done && jump) next = second;
+                break;
+            }
+            case Opcode::Halt: next = -1; break;
+            default: break;
+        }
+        if (!done) {
+            return unseen(state, status);
+        }
+        switch (entry.opcode) {
+            case Opcode::LoadFromMemory:
+            case Opcode::LoadImmediate:
+            case Opcode::Add:
+            case Opcode::AddFloat:
+            case Opcode::Or:
+            case Opcode::And:
+            case Opcode::Xor:
+            case Opcode::Rotate:
+                r = move(result);
+                break;
+            case Opcode::Move:
+                state.registers[second & 0xF] = move(result);
+                break;
+            default:
+                break;
+        }
+        state.programCounter = next;
+        ++state.steps;
+        return true;
+    }
+
+    // Reports state's path, or keeps the path already reported for the same decisions if its
+    // inputs are smaller
+    void finish(const ExplorerState &state, const string &status) {
+        Path path{state.concrete_inputs(), status, state.steps, state.programCounter, {}, {}};
+        for (int i = 0; i < 16; ++i) path.registers[i] = state.registers[i].at(path.inputs);
+        for (int i = 0; i < 256; ++i) path.cells[i] = state.cell(i).at(path.inputs);
+        lock_guard<mutex> guard(pathsLock);
+        auto found = pathByTrace.emplace(state.trace + status, paths.size());
+        if (found.second) paths.push_back(move(path));
+        else if (path.inputs < paths[found.first->second].inputs) paths[found.first->second] = move(path);
+    }
+
+    void work() {
+        while (true) {
+            ExplorerState state;
+            {
+                unique_lock<mutex> guard(queueLock);
+                workAvailable.wait(guard, [this]() { return !queue.empty() || active == 0; });
+                if (queue.empty()) return; // Nothing queued and nobody left to fork
+                state = move(queue.front());
+                queue.pop_front();
+                ++active;
+            }
+            string status;
+            while (step(state, status)) {}
+            if (!status.empty()) finish(state, status);
+            lock_guard<mutex> guard(queueLock);
+            if (--active == 0 && queue.empty()) workAvailable.notify_all();
+        }
+    }
+
+public:
+    Explorer(vector<int> inputs, long long steps, size_t limit) : inputCells(move(inputs)), maxSteps(steps), maxPaths(limit) {}
+
+    // Explores machine's loaded program from its current state. Returns the paths sorted by their
+    // concrete inputs; truncated is set if the path limit left some inputs unexplored.
+    vector<Path> explore(Machine &machine, int threads, bool &wasTruncated) {
+        ExplorerState initial;
+        initial.programCounter = machine.program_counter();
+        for (int i = 0; i < 16; ++i) initial.registers[i].value = machine.register_value(i);
+        for (auto &chunk : initial.chunks) chunk = make_shared<ExplorerState::Chunk>();
+        for (int address = 0; address < 256; ++address) {
+            initial.set_cell(address, SymbolicByte{{-1, -1}, static_cast<uint8_t>(machine.cell_value(address)), false, nullptr});
+        }
+        auto identity = make_shared<vector<uint8_t>>(256);
+        for (int x = 0; x < 256; ++x) (*identity)[x] = x;
+        for (size_t input = 0; input < inputCells.size(); ++input) {
+            int index = static_cast<int>(input);
+            initial.set_cell(inputCells[input], SymbolicByte{{index, -1}, 0, false, identity});
+            initial.factors.push_back(InputFactor{{index, -1}, vector<bool>(256, true)});
+            initial.factorOf.push_back(index);
+        }
+        seen.insert(initial.key());
+        queue.push_back(move(initial));
+
+        vector<thread> workers;
+        for (int i = 0; i < threads; ++i) workers.emplace_back(&Explorer::work, this);
+        for (thread &worker : workers) worker.join();
+
+        sort(paths.begin(), paths.end(), [](const Path &a, const Path &b) { return a.inputs < b.inputs; });
+        wasTruncated = truncated;
+        return paths;
+    }
+};
+
+int run_explore(int argc, char *argv[]) {
+    vector<int> inputs;
+    int startAddress = 0, threads = max(1u, thread::hardware_concurrency());
+    long long maxSteps = 100000;
+    size_t maxPaths = 100000;
+    bool valid = argc >= 3;
+    for (int i = 3; i + 1 < argc && valid; i += 2) {
+        string option = argv[i], value = argv[i + 1];
+        if (option == "--inputs") {
+            stringstream cells(value);
+            string cell;
+            while (getline(cells, cell, ',')) {
+                int address = parse_hex(cell);
+                valid = valid && address >= 0 && address <= 0xFF && find(inputs.begin(), inputs.end(), address) == inputs.end();
+                inputs.push_back(address);
+            }
+        } else if (option == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+            startAddress = parse_hex(value);
+        } else if (option == "--steps" && atoll(value.c_str()) > 0) {
+            maxSteps = atoll(value.c_str());
+        } else if (option == "--paths" && atoll(value.c_str()) > 0) {
+            maxPaths = atoll(value.c_str());
+        } else if (option == "--threads" && atoi(value.c_str()) > 0) {
+            threads = atoi(value.c_str());
+        } else {
+            valid = false;
+        }
+    }
+    ifstream file(valid && argc % 2 == 1 && !inputs.empty() ? argv[2] : "");
+    if (!file.is_open()) {
+        cout << "Usage: " << argv[0] << " --explore <program file> --inputs <cell>,<cell>,... [--start <address>]\n"
+             << "       [--steps <limit per path>] [--paths <fork limit>] [--threads <count>]\n";
+        return 1;
+    }
+
+    Machine machine;
+    machine.load_words(file, startAddress, cerr);
+    bool truncated = false;
+    vector<Explorer::Path> paths = Explorer(inputs, maxSteps, maxPaths).explore(machine, threads, truncated);
+    for (const Explorer::Path &path : paths) {
+        cout << "PATH inputs=";
+        for (size_t i = 0; i < inputs.size(); ++i) cout << (i ? "," : "") << "M" << hex_byte(inputs[i]) << ":" << hex_byte(path.inputs[i]);
+        cout << " status=" << path.status << " steps=" << path.steps << " pc=" << hex_byte(path.programCounter) << " regs=";
+        for (uint8_t value : path.registers) cout << hex_byte(value);
+        cout << " mem=";
+        for (uint8_t value : path.cells) cout << hex_byte(value);
+        cout << "\n";
+    }
+    cout << paths.size() << " paths" << (truncated ? "; the path limit was reached, so some inputs were not explored" : "") << endl;
+    return 0;
+}
+
+// Program archive (.vpa): many programs stored back to back behind an index, meant to be mapped
+// into memory and read in place. All integers are little-endian.
+//
+//   header   "VPAK", uint32 version (1), uint32 program count, uint32 reserved
+//   index    per program: uint32 record offset from the start of the file, uint32 record size
+//   records  per program: uint8 start address, uint8 register count (0 or 16),
+//            uint16 byte count, uint16 name length, uint16 reserved, then the initial registers,
+//            the program bytes (loaded at the start address) and the name
+struct ArchiveEntry {
+    int startAddress;
+    const uint8_t *registers; // Initial register values, or nullptr for all zero
+    const uint8_t *bytes;
+    size_t byteCount;
+    const char *name;
+    size_t nameLength;
+};
+
+class ProgramArchive {
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint32_t count = 0;
+
+    static uint32_t read32(const uint8_t *at) { return at[0] | at[1] << 8 | at[2] << 16 | uint32_t(at[3]) << 24; }
+    static uint16_t read16(const uint8_t *at) { return at[0] | at[1] << 8; }
+
+public:
+    // Maps path read-only; returns false with a message in error if it is not a valid archive
+    bool open(const string &path, string &error) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0) {
+            error = "Unable to open " + path;
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        size = info.st_size;
+        void *mapped = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            error = "Unable to map " + path;
+            return false;
+        }
+        data = static_cast<const uint8_t *>(mapped);
+        if (size < 16 || memcmp(data, "VPAK", 4) != 0 || read32(data + 4) != 1) {
+            error = path + " is not a version 1 program archive";
+            return false;
+        }
+        count = read32(data + 8);
+        if (size < 16 + uint64_t(count) * 8) {
+            error = path + " has a truncated index";
+            return false;
+        }
+        return true;
+    }
+
+    ~ProgramArchive() {
+        if (data) munmap(const_cast<uint8_t *>(data), size);
+    }
+
+    uint32_t program_count() const { return count; }
+
+    // The index-th program, pointing into the mapping; false if its record is malformed
+    bool entry(uint32_t index, ArchiveEntry &program) const {
+        const uint8_t *slot = data + 16 + index * 8;
+        uint64_t offset = read32(slot), recordSize = read32(slot + 4);
+        if (offset + recordSize > size || recordSize < 8) return false;
+        const uint8_t *record = data + offset;
+        program.startAddress = record[0];
+        size_t registerCount = record[1];
+        program.byteCount = read16(record + 2);
+        program.nameLength = read16(record + 4);
+        if ((registerCount != 0 && registerCount != 16) || program.startAddress + program.byteCount > 256
+            || 8 + registerCount + program.byteCount + program.nameLength > recordSize) {
+            return false;
+        }
+        program.registers = registerCount ? record + 8 : nullptr;
+        program.bytes = record + 8 + registerCount;
+        program.name = reinterpret_cast<const char *>(program.bytes + program.byteCount);
+        return true;
+    }
+};
+
+// Converts every file in a directory of hex text programs into one archive, loading each the
+// way load_program does
+int run_pack(int argc, char *argv[]) {
+    int startAddress = 0;
+    bool valid = argc >= 4 && argv[3][0] != '-' && filesystem::is_directory(argv[2]);
+    for (int i = 4; i < argc && valid; i += 2) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--start" && parse_hex(value) >= 0 && parse_hex(value) < 0xFF) {
+            startAddress = parse_hex(value);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        cout << "Usage: " << argv[0] << " --pack <directory of program files> <archive> [--start <address>]\n";
+        return 1;
+    }
+
+    vector<filesystem::path> files;
+    for (const auto &item : filesystem::directory_iterator(argv[2])) {
+        if (item.is_regular_file()) files.push_back(item.path());
+    }
+    sort(files.begin(), files.end());
+
+    auto put32 = [](string &out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(value >> (8 * i)));
+    };
+    auto put16 = [](string &out, uint16_t value) {
+        out.push_back(static_cast<char>(value));
+        out.push_back(static_cast<char>(value >> 8));
+    };
+
+    string index, records;
+    size_t recordsStart = 16 + files.size() * 8;
+    for (const filesystem::path &path : files) {
+        ifstream file(path);
+        Machine loader;
+        int skipped = 0;
+        int end = loader.load_words(file, startAddress, cerr, &skipped);
+        string name = path.filename().string();
+        if (skipped > 0) {
+            // Packing the rest would move every word after the skipped ones
+            cout << "Error: Unable to load every word of " << path.string() << " (" << skipped << " skipped)" << endl;
+            return 1;
+        }
+        string record;
+        record.push_back(static_cast<char>(startAddress));
+        record.push_back(0); // No initial registers: text programs start from zero
+        put16(record, end - startAddress);
+        put16(record, name.size());
+        put16(record, 0);
+        for (int address = startAddress; address < end; ++address) record.push_back(static_cast<char>(loader.cell_value(address)));
+        record += name;
+        put32(index, recordsStart + records.size());
+        put32(index, record.size());
+        records += record;
+    }
+
+    ofstream out(argv[3], ios::binary);
+    string header = "VPAK";
+    put32(header, 1);
+    put32(header, files.size());
+    put32(header, 0);
+    out << header << index << records;
+    if (!out) {
+        cout << "Error: Unable to write " << argv[3] << endl;
+        return 1;
+    }
+    cout << "Packed " << files.size() << " programs into " << argv[3] << endl;
+    return 0;
+}
+
+// Runs every program in an archive across worker threads, straight from the mapping, and
+// prints one CSV row per program in archive order. With --timing the programs run through a
+// CycleModel and each row also has the modelled cycles, stalls and cache hit rate.
+int run_archive(int argc, char *argv[]) {
+    long long maxSteps = 1000000;
+    int threads = max(1u, thread::hardware_concurrency());
+    CycleCosts costs;
+    bool timing = false;
+    string error;
+    bool valid = argc >= 3 && argv[2][0] != '-';
+    for (int i = 3; i < argc && valid; i += 2) {
+        string option = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (option == "--steps" && atoll(value.c_str()) > 0) {
+            maxSteps = atoll(value.c_str());
+        } else if (option == "--threads" && atoi(value.c_str()) > 0) {
+            threads = atoi(value.c_str());
+        } else if (option == "--timing" && i + 1 < argc && costs.parse(value, error)) {
+            timing = true;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        if (!error.empty()) cout << "Error: " << error << "\n";
+        cout << "Usage: " << argv[0] << " --run-archive <archive> [--steps <limit>] [--threads <count>] [--timing <costs>]\n";
+        return 1;
+    }
+    ProgramArchive archive;
+    if (!archive.open(argv[2], error)) {
+        cout << "Error: " << error << endl;
+        return 1;
+    }
+
+    vector<string> rows(archive.program_count());
+    atomic<uint32_t> next(0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (uint32_t i = next++; i < archive.program_count(); i = next++) {
+                ArchiveEntry program;
+                if (!archive.entry(i, program)) {
+                    rows[i] = to_string(i) + ",malformed,0," + (timing ? ",,," : ""); // Every column, left empty
+                    continue;
+                }
+                stringstream row;
+                row.write(program.name, program.nameLength);
+                Machine machine;
+                machine.load_image(program.startAddress, program.bytes, program.byteCount, program.registers);
+                machine.set_timing(timing ? &costs : nullptr);
+                long long steps = machine.run_silent(maxSteps);
+                row << "," << machine.stop_reason(steps, maxSteps) << "," << steps << ",";
+                for (int r = 0; r < 16; ++r) row << hex_byte(machine.register_value(r));
+                if (const CycleModel *model = machine.cycle_model()) {
+                    row << "," << model->cycles << "," << model->stalls << ",";
+                    if (model->hit_rate() >= 0) row << fixed << setprecision(1) << model->hit_rate();
+                }
+                rows[i] = row.str();
+            }
+        });
+    }
+    for (thread &worker : workers) worker.join();
+
+    cout << "name,status,steps,registers" << (timing ? ",cycles,stalls,hit_rate\n" : "\n");
+    for (const string &row : rows) cout << row << "\n";
+    return 0;
+}
+
+// Loops forever through every opcode, including a store and load through memory. --bench runs it
+// when no program file is given.
+const char *builtInProgram =
+    "2101 2200 2000 5221 6322 7423 8523 9623 A603 3680 1780 4078 D81C 2900 B006";
+
+// Semantics of the two-operand ALU opcodes: the result byte for operand bytes a and b
+using AluSemantics = uint8_t (*)(Opcode opcode, uint8_t a, uint8_t b);
+
+// AddFloat as first written for this machine, in doubles: (-1)^S * (1 + M/16) * 2^(E-4), the
+// result exponent from log2 truncated toward zero, saturating at both ends
+uint8_t reference_float_add(uint8_t a, uint8_t b) {
+    const int bias = 4;
+    double sum = 0;
+    for (uint8_t value : {a, b}) {
+        sum += pow(-1, value >> 7) * (1 + (value & 0xF) / 16.0) * pow(2, ((value >> 4) & 0x7) - bias);
+    }
+    int sign = sum < 0 ? 1 : 0;
+    sum = abs(sum);
+    int exponent = 0, mantissa = 0;
+    if (sum != 0) {
+        exponent = static_cast<int>(log2(sum));
+        mantissa = static_cast<int>((sum / pow(2, exponent)) * 16) & 0xF;
+        exponent += bias;
+        if (exponent > 7) {
+            exponent = 7;
+            mantissa = 0xF;
+        } else if (exponent < 0) {
+            exponent = 0;
+            mantissa = 0;
+        }
+    }
+    return (sign << 7) | ((exponent & 0x7) << 4) | mantissa;
+}
+
+// AddFloat as main.cpp computes it: no implicit leading 1, the biased exponent truncated after
+// adding the bias, and no saturation, so out-of-range exponents keep their low 3 bits
+uint8_t legacy_float_add(uint8_t a, uint8_t b) {
+    const int bias = 4;
+    double sum = 0;
+    for (uint8_t value : {a, b}) {
+        sum += pow(-1, value >> 7) * ((value & 0xF) / 16.0) * pow(2, ((value >> 4) & 0x7) - bias);
+    }
+    int sign = sum < 0 ? 1 : 0;
+    sum = abs(sum);
+    int exponent = 0, mantissa = 0;
+    if (sum != 0) {
+        exponent = log2(sum) + bias;
+        mantissa = static_cast<int>((sum / pow(2, exponent - bias)) * 16) & 0xF;
+    }
+    return (sign << 7) | ((exponent & 0x7) << 4) | mantissa;
+}
+
+uint8_t reference_alu(Opcode opcode, uint8_t a, uint8_t b) {
+    switch (opcode) {
+        case Opcode::Add: return (static_cast<int8_t>(a) + static_cast<int8_t>(b)) & 0xFF;
+        case Opcode::AddFloat: return reference_float_add(a, b);
+        case Opcode::Or: return a | b;
+        case Opcode::And: return a & b;
+        case Opcode::Xor: return a ^ b;
+        default: return 0;
+    }
+}
+
+// main.cpp differs from the reference only in AddFloat; it has no logic opcodes
+uint8_t legacy_alu(Opcode opcode, uint8_t a, uint8_t b) {
+    return opcode == Opcode::AddFloat ? legacy_float_add(a, b) : reference_alu(opcode, a, b);
+}
+
+// First byte of the word R3 = R1 op R2
+int alu_first_byte(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::Add: return 0x53;
+        case Opcode::AddFloat: return 0x63;
+        case Opcode::Or: return 0x73;
+        case Opcode::And: return 0x83;
+        default: return 0x93;
+    }
+}
+
+// One step of Machine, through its decoded instruction cache
+uint8_t instruction_alu(Opcode opcode, uint8_t a, uint8_t b) {
+    thread_local Machine machine;
+    machine.set_cell(0, alu_first_byte(opcode));
+    machine.set_cell(1, 0x12);
+    machine.jump_to(0);
+    machine.set_register(1, a);
+    machine.set_register(2, b);
+    machine.step(nullptr);
+    return machine.register_value(3);
+}
+
+// One step of ConstexprMachine, which decodes as it fetches
+uint8_t constexpr_alu(Opcode opcode, uint8_t a, uint8_t b) {
+    thread_local ConstexprMachine machine;
+    machine.memory[0] = alu_first_byte(opcode);
+    machine.memory[1] = 0x12;
+    machine.programCounter = 0;
+    machine.registers[1] = a;
+    machine.registers[2] = b;
+    machine.step();
+    return machine.registers[3];
+}
+
+const pair<const char *, AluSemantics> aluSemantics[] = {
+    {"reference", reference_alu}, {"legacy", legacy_alu}, {"instruction", instruction_alu}, {"constexpr", constexpr_alu}};
+
+// Compares an ALU implementation with a reference on every pair of operand bytes for each
+// two-operand opcode, spread over worker threads, and lists the first mismatches per opcode
+int run_verify_alu(int argc, char *argv[]) {
+    AluSemantics tested = instruction_alu, reference = reference_alu;
+    string testedName = "instruction", referenceName = "reference";
+    int threads = max(1u, thread::hardware_concurrency());
+    bool valid = true;
+    for (int i = 2; i + 1 < argc && valid; i += 2) {
+        string option = argv[i], value = argv[i + 1];
+        auto found = find_if(begin(aluSemantics), end(aluSemantics), [&](const auto &entry) { return value == entry.first; });
+        if (option == "--threads" && atoi(argv[i + 1]) > 0) {
+            threads = atoi(argv[i + 1]);
+        } else if ((option == "--impl" || option == "--reference") && found != end(aluSemantics)) {
+            (option == "--impl" ? tested : reference) = found->second;
+            (option == "--impl" ? testedName : referenceName) = value;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || argc % 2 != 0) {
+        cout << "Usage: " << argv[0] << " --verify-alu [--impl <semantics>] [--reference <semantics>] [--threads <count>]\n"
+             << "Semantics: reference, legacy (main.cpp), instruction (Machine), constexpr (ConstexprMachine)\n";
+        return 1;
+    }
+
+    const Opcode opcodes[] = {Opcode::Add, Opcode::AddFloat, Opcode::Or, Opcode::And, Opcode::Xor};
+    const int opcodeCount = sizeof(opcodes) / sizeof(opcodes[0]);
+    const size_t examplesShown = 5;
+    struct Mismatch {
+        int a, b, got, expected;
+        bool operator<(const Mismatch &other) const { return a != other.a ? a < other.a : b < other.b; }
+    };
+    array<atomic<long long>, opcodeCount> mismatches{};
+    array<vector<Mismatch>, opcodeCount> examples;
+    mutex examplesMutex;
+    atomic<int> next(0); // Task: one opcode and first operand
+
+    auto started = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (int task = next++; task < opcodeCount * 256; task = next++) {
+                int index = task / 256, a = task % 256;
+                long long found = 0;
+                vector<Mismatch> first;
+                for (int b = 0; b < 256; ++b) {
+                    uint8_t got = tested(opcodes[index], a, b), expected = reference(opcodes[index], a, b);
+                    if (got != expected && found++ < static_cast<long long>(examplesShown)) first.push_back({a, b, got, expected});
+                }
+                if (found) {
+                    mismatches[index] += found;
+                    lock_guard<mutex> lock(examplesMutex);
+                    examples[index].insert(examples[index].end(), first.begin(), first.end());
+                }
+            }
+        });
+    }
+    for (thread &worker : workers) worker.join();
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+    cout << "Verifying " << testedName << " against " << referenceName << " on " << opcodeCount * 65536
+         << " operand pairs with " << threads << " threads\n";
+    long long total = 0;
+    for (int index = 0; index < opcodeCount; ++index) {
+        const char *mnemonic = decodeTable[alu_first_byte(opcodes[index])].mnemonic;
+        cout << mnemonic << ": " << mismatches[index] << " mismatches\n";
+        sort(examples[index].begin(), examples[index].end());
+        for (size_t i = 0; i < examples[index].size() && i < examplesShown; ++i) {
+            const Mismatch &m = examples[index][i];
+            cout << "  " << mnemonic << " " << hex_byte(m.a) << ", " << hex_byte(m.b) << ": got " << hex_byte(m.got)
+                 << ", expected " << hex_byte(m.expected) << "\n";
+        }
+        total += mismatches[index];
+    }
+    cout << fixed << setprecision(1) << "Finished in " << elapsed << " ms" << endl;
+    return total == 0 ? 0 : 1;
+}
+
+// Times a program on Machine three ways: run_silent, which also fast-forwards counting loops, and
+// plain unchecked and checked stepping through the same step, and checks that all three finish
+// in the same state. With --debug the program runs once checked instead, tracing every
+// instruction and counting opcodes. With --timing it also runs through a CycleModel and reports
+// the modelled cycles.
+int run_bench(int argc, char *argv[]) {
+    long long steps = 10000000;
+    string filename, error;
+    bool debug = false, timing = false;
+    CycleCosts costs;
+    for (int i = 2; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--steps" && i + 1 < argc && atoll(argv[i + 1]) > 0) {
+            steps = atoll(argv[++i]);
+        } else if (option == "--debug") {
+            debug = true;
+        } else if (option == "--timing" && i + 1 < argc && costs.parse(argv[i + 1], error)) {
+            timing = true;
+            ++i;
+        } else if (filename.empty() && option[0] != '-') {
+            filename = option;
+        } else {
+            if (!error.empty()) cout << "Error: " << error << "\n";
+            cout << "Usage: " << argv[0] << " --bench [program file] [--steps <count>] [--debug] [--timing <costs>]\n";
+            return 1;
+        }
+    }
+
+    Machine machine;
+    ifstream file(filename);
+    stringstream builtIn(builtInProgram);
+    if (!filename.empty() && !file.is_open()) {
+        cout << "Error: Unable to open file " << filename << endl;
+        return 1;
+    }
+    machine.load_words(filename.empty() ? static_cast<istream &>(builtIn) : file, 0, cerr);
+
+    NoTrace silent;
+    if (debug) {
+        StreamTrace trace{&cout};
+        OpcodeStats stats;
+        long long executed = machine.run_with<CheckedBounds>(steps, trace, stats);
+        cout << "Executed " << executed << " instructions\n";
+        stats.report(cout);
+        return 0;
+    }
+
+    NoStats none;
+    Machine unchecked = machine, checked = machine, timed = machine;
+    auto started = chrono::steady_clock::now();
+    long long silentSteps = machine.run_silent(steps);
+    auto silentFinished = chrono::steady_clock::now();
+    long long uncheckedSteps = unchecked.run_with<UncheckedBounds>(steps, silent, none);
+    auto uncheckedFinished = chrono::steady_clock::now();
+    long long checkedSteps = checked.run_with<CheckedBounds>(steps, silent, none);
+    auto checkedFinished = chrono::steady_clock::now();
+
+    auto rate = [](long long count, chrono::steady_clock::duration elapsed) {
+        double seconds = chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? count / seconds / 1e6 : 0.0;
+    };
+    cout << fixed << setprecision(1);
+    cout << "run_silent: " << silentSteps << " instructions, " << rate(silentSteps, silentFinished - started) << " M/s\n";
+    cout << "Unchecked:  " << uncheckedSteps << " instructions, " << rate(uncheckedSteps, uncheckedFinished - silentFinished) << " M/s\n";
+    cout << "Checked:    " << checkedSteps << " instructions, " << rate(checkedSteps, checkedFinished - uncheckedFinished) << " M/s\n";
+    if (timing) {
+        timed.set_timing(&costs);
+        auto timedStarted = chrono::steady_clock::now();
+        long long timedSteps = timed.run_silent(steps);
+        auto timedFinished = chrono::steady_clock::now();
+        const CycleModel &model = *timed.cycle_model();
+        cout << "Timed:      " << timedSteps << " instructions, " << rate(timedSteps, timedFinished - timedStarted)
+             << " M/s, " << model.cycles << " cycles, " << model.stalls << " stalls";
+        if (model.hit_rate() >= 0) cout << ", " << model.hit_rate() << "% cache hits";
+        cout << "\n";
+    }
+
+    auto same = [&](Machine &other, long long otherSteps) {
+        bool equal = otherSteps == silentSteps && other.program_counter() == machine.program_counter();
+        for (int r = 0; r < 16; ++r) equal = equal && other.register_value(r) == machine.register_value(r);
+        for (int address = 0; address < 256; ++address) equal = equal && other.cell_value(address) == machine.cell_value(address);
+        return equal;
+    };
+    bool match = same(unchecked, uncheckedSteps) && same(checked, checkedSteps);
+    cout << (match ? "Final states match" : "MISMATCH: final states differ") << endl;
+    return match ? 0 : 1;
+}
+
+// Test programs include this file to reach the machine, and bring their own main
+#ifndef VOLE_MACHINE_NO_MAIN
+int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--sweep") {
+        return run_sweep(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--stream") {
+        return run_stream(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--multi") {
+        return run_multiprocessor(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--daemon") {
+        return run_daemon(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--explore") {
+        return run_explore(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--asm") {
+        return run_assemble(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--gdb") {
+        return run_gdb(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--pack") {
+        return run_pack(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--run-archive") {
+        return run_archive(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--verify-alu") {
+        return run_verify_alu(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        return run_bench(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--profile") {
+        return run_profile(argc, argv);
+    }
+    Machine machine;
+    machine.menu();
+    return 0;
+}
+#endif
\ No newline at end of file
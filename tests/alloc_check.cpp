@@ -0,0 +1,90 @@
+// Checks that executing instructions never allocates: counts every heap allocation, plain and
+// aligned, through replacement operators new and runs a program silently for a long time.
+//
+//     g++ -std=c++17 -O2 -pthread -o alloc_check tests/alloc_check.cpp
+//     ./alloc_check [program file] [--steps <count>]
+#define VOLE_MACHINE_NO_MAIN
+#include "../VoleMachine.cpp"
+
+// Heap allocations made by the current thread
+thread_local size_t allocationCount = 0;
+
+void *counted_allocation(size_t size) {
+    ++allocationCount;
+    if (void *block = malloc(size ? size : 1)) return block;
+    throw bad_alloc();
+}
+
+void *counted_allocation(size_t size, align_val_t alignment) {
+    ++allocationCount;
+    size_t bytes = static_cast<size_t>(alignment);
+    size_t rounded = ((size ? size : 1) + bytes - 1) / bytes * bytes;
+    if (void *block = aligned_alloc(bytes, rounded)) return block;
+    throw bad_alloc();
+}
+
+void *operator new(size_t size) { return counted_allocation(size); }
+void *operator new[](size_t size) { return counted_allocation(size); }
+void *operator new(size_t size, align_val_t alignment) { return counted_allocation(size, alignment); }
+void *operator new[](size_t size, align_val_t alignment) { return counted_allocation(size, alignment); }
+
+void operator delete(void *block) noexcept { free(block); }
+void operator delete[](void *block) noexcept { free(block); }
+void operator delete(void *block, size_t) noexcept { free(block); }
+void operator delete[](void *block, size_t) noexcept { free(block); }
+void operator delete(void *block, align_val_t) noexcept { free(block); }
+void operator delete[](void *block, align_val_t) noexcept { free(block); }
+void operator delete(void *block, size_t, align_val_t) noexcept { free(block); }
+void operator delete[](void *block, size_t, align_val_t) noexcept { free(block); }
+
+// Allocations made while running body
+template <typename Body>
+size_t allocations_during(Body body) {
+    size_t before = allocationCount;
+    body();
+    return allocationCount - before;
+}
+
+int main(int argc, char *argv[]) {
+    long long steps = 10000000;
+    string filename;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--steps" && i + 1 < argc && atoll(argv[i + 1]) > 0) {
+            steps = atoll(argv[++i]);
+        } else if (filename.empty() && option[0] != '-') {
+            filename = option;
+        } else {
+            cout << "Usage: " << argv[0] << " [program file] [--steps <count>]\n";
+            return 1;
+        }
+    }
+
+    // The counter must see aligned allocations too, or an over-aligned type could slip through
+    struct alignas(64) Line {
+        char bytes[64];
+    };
+    if (allocations_during([] { delete new Line; }) != 1) {
+        cout << "FAILED: aligned operator new is not counted." << endl;
+        return 1;
+    }
+
+    Machine machine;
+    ifstream file(filename);
+    stringstream builtIn(builtInProgram);
+    if (!filename.empty() && !file.is_open()) {
+        cout << "Error: Unable to open file " << filename << endl;
+        return 1;
+    }
+    machine.load_words(filename.empty() ? static_cast<istream &>(builtIn) : file, 0, cerr);
+
+    long long executed = 0;
+    size_t allocations = allocations_during([&] { executed = machine.run_silent(steps); });
+    cout << "Executed " << executed << " instructions with " << allocations << " heap allocations." << endl;
+    if (allocations != 0) {
+        cout << "FAILED: the execution loop allocated." << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Differential test of Machine::run_silent, which fast-forwards counting loops, against plain
+// stepping: both must execute the same number of instructions and reach the same state, and with
+// timing on count the same cycles, stalls and cache hits and misses. Runs fixed layouts known to matter and then random programs built mostly from LOADI, ADD and
+// jumps, so that counting loops with every head alignment are common. Finally checks that loops
+// which never exit, or not within the step limit, are skipped rather than stepped, also on a
+// machine that ran another program first.
+//
+//     g++ -std=c++17 -O2 -pthread -o fast_forward_check tests/fast_forward_check.cpp
+//     ./fast_forward_check [--cases <count>] [--seed <seed>]
+#define VOLE_MACHINE_NO_MAIN
+#include "../VoleMachine.cpp"
+
+struct Case {
+    array<uint8_t, 256> image{};
+    array<uint8_t, 16> registers{};
+    int start = 0;
+    long long maxSteps = 0;
+};
+
+// Whether two machines have the same program counter, registers and memory
+bool same_state(Machine &a, Machine &b) {
+    bool same = a.program_counter() == b.program_counter();
+    for (int r = 0; r < 16; ++r) same = same && a.register_value(r) == b.register_value(r);
+    for (int address = 0; address < 256; ++address) same = same && a.cell_value(address) == b.cell_value(address);
+    return same;
+}
+
+// Runs one case both ways, timed with costs unless they are null, and reports any difference on
+// out. Returns whether they agree.
+bool agrees(const Case &test, ostream &out, const CycleCosts *costs = nullptr) {
+    Machine fast, plain;
+    fast.load_image(0, test.image.data(), test.image.size(), test.registers.data());
+    plain.load_image(0, test.image.data(), test.image.size(), test.registers.data());
+    fast.jump_to(test.start);
+    plain.jump_to(test.start);
+    fast.set_timing(costs);
+
+    long long fastSteps = fast.run_silent(test.maxSteps);
+    NoTrace trace;
+    NoStats none;
+    CycleModel model;
+    model.costs = costs;
+    long long plainSteps = costs ? plain.run_with<UncheckedBounds>(test.maxSteps, trace, model)
+                                 : plain.run_with<UncheckedBounds>(test.maxSteps, trace, none);
+
+    bool same = fastSteps == plainSteps && same_state(fast, plain);
+    const CycleModel *timed = fast.cycle_model();
+    if (costs) {
+        same = same && timed->cycles == model.cycles && timed->stalls == model.stalls && timed->hits == model.hits
+               && timed->misses == model.misses;
+    }
+    if (!same) {
+        out << "MISMATCH from Memory[" << test.start << "] with " << test.maxSteps << " steps"
+            << (costs ? (costs->lines ? " timed with a cache" : " timed") : "") << ": run_silent executed "
+            << fastSteps << " to pc " << fast.program_counter() << ", stepping executed " << plainSteps << " to pc "
+            << plain.program_counter();
+        if (costs) out << "; cycles " << timed->cycles << " and " << model.cycles << ", hits " << timed->hits << " and " << model.hits;
+        out << "\n  image:";
+        for (uint8_t byte : test.image) out << " " << hex_byte(byte);
+        out << "\n  registers:";
+        for (uint8_t value : test.registers) out << " " << hex_byte(value);
+        out << "\n";
+    }
+    return same;
+}
+
+// A case whose program is the given words from Memory[0], run from start
+Case words_case(const vector<uint16_t> &words, int start, long long maxSteps) {
+    Case test;
+    for (size_t i = 0; i < words.size(); ++i) {
+        test.image[2 * i] = words[i] >> 8;
+        test.image[2 * i + 1] = words[i] & 0xFF;
+    }
+    test.start = start;
+    test.maxSteps = maxSteps;
+    return test;
+}
+
+// A random program built around a counting loop: setup LOADIs, a body of ADDs with one exit
+// JMPEQ, and an unconditional back jump. Most loops fit Cpu::fast_forward; the rest break one of
+// its conditions, e.g. the head is moved to an odd address or a step register is changed.
+Case random_case(mt19937 &random) {
+    auto pick = [&random](int bound) { return static_cast<int>(random() % bound); };
+    Case test;
+    for (uint8_t &value : test.registers) value = pick(4) == 0 ? pick(256) : pick(8);
+    for (uint8_t &byte : test.image) byte = pick(8) == 0 ? pick(256) : 0;
+
+    int address = 2 * pick(32);
+    test.start = address;
+    auto emit = [&](int first, int second) {
+        if (address + 1 < 256) {
+            test.image[address] = first;
+            test.image[address + 1] = second;
+        }
+        address += 2;
+    };
+    // Counters come from R1-R7 and steps from R8-RF, so ADDs rarely change a step register
+    auto counter = [&]() { return pick(16) == 0 ? pick(16) : 1 + pick(7); };
+    auto step = [&]() { return pick(16) == 0 ? pick(16) : 8 + pick(8); };
+    for (int i = pick(5); i > 0; --i) emit(0x20 | (pick(2) == 0 ? counter() : step()), pick(256));
+
+    int head = address, length = 1 + pick(6), exit = pick(length);
+    vector<pair<int, int>> body;
+    for (int i = 0; i < length; ++i) {
+        int dest = counter(), other = step();
+        if (i == exit) body.push_back({0xB0 | counter(), 0}); // Target patched once the end is known
+        else body.push_back({0x50 | dest, pick(2) == 0 ? (dest << 4) | other : (other << 4) | dest});
+    }
+    if (pick(8) == 0) body[pick(length)] = {pick(256), pick(256)};
+    for (const auto &word : body) emit(word.first, word.second);
+    int jump = address;
+    emit(0xB0, head);
+    emit(0xC0, 0x00);
+    if (exit * 2 + head + 1 < 256) test.image[head + 2 * exit + 1] = pick(8) == 0 ? pick(256) : jump + 2;
+
+    switch (pick(6)) {
+        case 0: test.image[jump + 1] = head + (pick(2) == 0 ? 1 : -1); break; // Odd distance to the head
+        case 1: test.image[jump + 1] = head + 2 * pick(length + 1); break;    // A later head
+        default: break;
+    }
+    test.maxSteps = 1 + pick(pick(4) == 0 ? 100000 : 3000);
+    return test;
+}
+
+int main(int argc, char *argv[]) {
+    long long cases = 20000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i += 2) {
+        string option = argv[i];
+        if (option == "--cases" && i + 1 < argc && atoll(argv[i + 1]) > 0) {
+            cases = atoll(argv[i + 1]);
+        } else if (option == "--seed" && i + 1 < argc) {
+            seed = strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            cout << "Usage: " << argv[0] << " [--cases <count>] [--seed <seed>]\n";
+            return 1;
+        }
+    }
+
+    vector<Case> fixed = {
+        // The loop head is odd while the back jump is at an even address, so stepping runs the
+        // loop through misaligned words
+        words_case({0x2101, 0x2005, 0xB00C, 0x2052, 0x21B2, 0x4053, 0xB007, 0xC000}, 0, 1000),
+        // The same loop with its head aligned, which is fast-forwarded
+        words_case({0x2101, 0x2005, 0x2203, 0x5112, 0xB10C, 0xB006, 0xC000}, 0, 1000),
+        // A counting loop that never exits, stopped by the step limit
+        words_case({0x2102, 0x2001, 0x5221, 0xB200, 0xB004, 0xC000}, 0, 99999),
+        // A budget that ends inside the loop
+        words_case({0x2101, 0x20F0, 0x5331, 0xB30C, 0xB004, 0xC000, 0xC000}, 0, 101),
+        // A counting loop that never exits with a budget that is not a whole number of iterations
+        words_case({0x2102, 0x2001, 0x5221, 0xB20A, 0xB004, 0xC000}, 0, 1000001),
+    };
+
+    // Each case also runs timed without a cache and with a small one whose lines the loops share
+    CycleCosts flat, cached;
+    string error;
+    flat.parse("ADD=2,JMPEQ=3,memory=5", error);
+    cached.parse("ADD=2,JMPEQ=3,memory=10,hit=1,lines=4,line=4", error);
+    auto check = [&](const Case &test) {
+        return !agrees(test, cout) + !agrees(test, cout, &flat) + !agrees(test, cout, &cached);
+    };
+
+    long long failures = 0;
+    for (const Case &test : fixed) failures += check(test);
+    mt19937 random(seed);
+    for (long long i = 0; i < cases && failures < 10; ++i) failures += check(random_case(random));
+
+    cout << fixed.size() + cases << " cases, " << failures << " mismatches" << endl;
+
+    // Stepping 10^9 instructions takes several seconds, so run_silent must skip these loops to be
+    // usable; stepping is only done for the equivalent budget. Both run two LOADIs and then a
+    // three-instruction loop whose counter R2 repeats every 128 iterations, so the state after
+    // limit instructions is the state after 2 + (limit - 2) % 384. The time is only reported.
+    const long long limit = 1000000000;
+    for (const Case &test : {fixed[2], fixed[4]}) {
+        Machine fast, plain;
+        fast.load_image(0, test.image.data(), test.image.size(), test.registers.data());
+        plain.load_image(0, test.image.data(), test.image.size(), test.registers.data());
+        fast.jump_to(test.start);
+        plain.jump_to(test.start);
+        auto begin = chrono::steady_clock::now();
+        long long executed = fast.run_silent(limit);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        for (long long steps = 2 + (limit - 2) % 384; steps > 0 && plain.step(nullptr); --steps) {}
+        if (executed != limit || !same_state(fast, plain)) {
+            cout << "MISMATCH: run_silent executed " << executed << " of " << limit << " instructions to pc "
+                 << fast.program_counter() << ", expected pc " << plain.program_counter() << endl;
+            ++failures;
+        }
+        cout << "run_silent(" << limit << ") took " << seconds << " s" << endl;
+    }
+    // A loop rejected in one program must not stay rejected in the next program loaded into the
+    // same machine. The second loop differs from the first only in its body and never exits;
+    // stepping through 10^15 instructions of it would take weeks, so with a stale rejection this
+    // never finishes. The state is again that after 2 + (budget - 2) % 384 instructions.
+    const long long budget = 1000000000000000;
+    Case rejected = words_case({0x2001, 0x2202, 0x2300, 0xB30A, 0xB004, 0xC000}, 0, 1000);
+    Case counting = words_case({0x2001, 0x2202, 0x5332, 0xB30A, 0xB004, 0xC000}, 0, budget);
+    Machine warm, plain;
+    warm.load_image(0, rejected.image.data(), rejected.image.size(), rejected.registers.data());
+    warm.run_silent(rejected.maxSteps);
+    warm.load_image(0, counting.image.data(), counting.image.size(), counting.registers.data());
+    plain.load_image(0, counting.image.data(), counting.image.size(), counting.registers.data());
+    long long executed = warm.run_silent(budget);
+    for (long long steps = 2 + (budget - 2) % 384; steps > 0 && plain.step(nullptr); --steps) {}
+    if (executed != budget || !same_state(warm, plain)) {
+        cout << "MISMATCH: after another program, run_silent executed " << executed << " of " << budget
+             << " instructions to pc " << warm.program_counter() << ", expected pc " << plain.program_counter() << endl;
+        ++failures;
+    }
+    cout << (failures == 0 ? "PASSED" : "FAILED") << endl;
+    return failures == 0 ? 0 : 1;
+}